@@ -8,684 +8,7906 @@
 #include <algorithm>
 #include <fstream>
 #include <iomanip>
-#include <windows.h>
 #include <climits>
+#include <cstdint>
+#include <deque>
+#include <string_view>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <charconv>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <map>
+#include <ctime>
+#include <cmath>
+#include <optional>
+#include <functional>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <csignal>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#endif
 
 using namespace std;
 
-class Waitlist
+// Read-only memory mapping of a whole file. An empty file maps to an empty view.
+class MappedFile
 {
-    queue<string> customerQueue;
+    const char *base;
+    size_t length;
+    bool opened;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
 
 public:
-    void enqueue(const string &customer)
+    MappedFile() : base(nullptr), length(0), opened(false)
     {
-        customerQueue.push(customer);
+#ifdef _WIN32
+        file = INVALID_HANDLE_VALUE;
+        mapping = nullptr;
+#endif
     }
 
-    string dequeue()
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile()
     {
-        if (!customerQueue.empty())
-        {
-            string customer = customerQueue.front();
-            customerQueue.pop();
-            return customer;
-        }
-        return "Waitlist is empty.";
+        close();
     }
 
-    void displayWaitlist()
+    bool open(const string &path)
     {
-        queue<string> temp = customerQueue;
-        if (temp.empty())
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                           OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize))
         {
-            cout << "Waitlist is empty." << endl;
-            return;
+            close();
+            return false;
         }
-        cout << "Waitlist:" << endl;
-        while (!temp.empty())
+        length = (size_t)fileSize.QuadPart;
+        if (length > 0)
         {
-            cout << temp.front() << endl;
-            temp.pop();
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping)
+                base = (const char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            if (!base)
+            {
+                close();
+                return false;
+            }
+        }
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0)
+        {
+            ::close(fd);
+            return false;
         }
+        length = (size_t)info.st_size;
+        if (length > 0)
+        {
+            void *view = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (view == MAP_FAILED)
+            {
+                ::close(fd);
+                length = 0;
+                return false;
+            }
+            base = (const char *)view;
+        }
+        ::close(fd);
+#endif
+        opened = true;
+        return true;
     }
 
-    bool isEmpty() const
+    void close()
+    {
+#ifdef _WIN32
+        if (base)
+            UnmapViewOfFile(base);
+        if (mapping)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (base)
+            munmap((void *)base, length);
+#endif
+        base = nullptr;
+        length = 0;
+        opened = false;
+    }
+
+    bool isOpen() const
     {
-        return customerQueue.empty();
+        return opened;
+    }
+
+    const char *data() const
+    {
+        return base;
+    }
+
+    size_t size() const
+    {
+        return length;
+    }
+
+    string_view view() const
+    {
+        return string_view(base, length);
     }
 };
 
-class ActionStack
+// Forces a written file's contents to disk.
+inline bool syncFileToDisk(const string &path)
 {
-    stack<string> actions;
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    bool synced = FlushFileBuffers(file) != 0;
+    CloseHandle(file);
+    return synced;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    bool synced = fsync(fd) == 0;
+    ::close(fd);
+    return synced;
+#endif
+}
+
+// Runs fn(i) for every i in [0, count) on up to `threads` worker threads.
+template <typename Fn>
+void parallelFor(size_t count, unsigned threads, Fn fn)
+{
+    if (threads == 0)
+        threads = max(1u, thread::hardware_concurrency());
+    threads = (unsigned)min<size_t>(threads, count);
+    if (threads <= 1)
+    {
+        for (size_t i = 0; i < count; i++)
+            fn(i);
+        return;
+    }
+
+    atomic<size_t> next(0);
+    auto worker = [&]()
+    {
+        for (size_t i = next++; i < count; i = next++)
+            fn(i);
+    };
+    vector<thread> pool;
+    for (unsigned t = 1; t < threads; t++)
+        pool.emplace_back(worker);
+    worker();
+    for (thread &th : pool)
+        th.join();
+}
+
+inline int highestSetBit(uint64_t word)
+{
+#ifdef _MSC_VER
+    int index = 0;
+    while (word >>= 1)
+        index++;
+    return index;
+#else
+    return 63 - __builtin_clzll(word);
+#endif
+}
+
+enum class Metric : uint8_t
+{
+    Book,
+    Return,
+    Login,
+    Register,
+    Quote,
+    ShortestPath,
+    Waitlist,
+    Count
+};
+
+const int metricCount = (int)Metric::Count;
+
+inline const char *metricName(Metric metric)
+{
+    static const char *const names[metricCount] = {"book", "return", "login", "register", "quote", "shortestPath", "waitlist"};
+    return names[(int)metric];
+}
+
+// Log-linear latency buckets in nanoseconds, as in HdrHistogram: exact below
+// 64 ns, then 32 sub-buckets per power of two (at most ~3% error).
+struct LatencyBuckets
+{
+    static constexpr int subBucketBits = 5;
+    static constexpr int subBuckets = 1 << subBucketBits;
+    static constexpr int count = (65 - subBucketBits) * subBuckets;
+
+    static int of(uint64_t value)
+    {
+        if (value < 2 * subBuckets)
+            return (int)value;
+        int shift = highestSetBit(value) - subBucketBits;
+        return (shift + 1) * subBuckets + (int)(value >> shift) - subBuckets;
+    }
+
+    // Largest value that lands in bucket.
+    static uint64_t highest(int bucket)
+    {
+        if (bucket < 2 * subBuckets)
+            return (uint64_t)bucket;
+        int shift = bucket / subBuckets - 1;
+        uint64_t low = (uint64_t)(bucket % subBuckets + subBuckets) << shift;
+        return low + ((uint64_t(1) << shift) - 1);
+    }
+};
+
+// Latency histograms and counters per operation. Each thread records into
+// its own shard with plain relaxed load/store pairs, so the hot path takes
+// no lock and no atomic read-modify-write; readers sum all shards. Shards
+// outlive their threads so nothing recorded is lost.
+class OperationMetrics
+{
+    struct Shard
+    {
+        atomic<uint64_t> buckets[metricCount][LatencyBuckets::count];
+        atomic<uint64_t> totalNanoseconds[metricCount];
+        atomic<uint64_t> maximum[metricCount];
+
+        Shard()
+        {
+            for (int m = 0; m < metricCount; m++)
+            {
+                for (atomic<uint64_t> &bucket : buckets[m])
+                    bucket.store(0, memory_order_relaxed);
+                totalNanoseconds[m].store(0, memory_order_relaxed);
+                maximum[m].store(0, memory_order_relaxed);
+            }
+        }
+    };
+
+    mutex lock;
+    vector<unique_ptr<Shard>> shards;
+    chrono::steady_clock::time_point started = chrono::steady_clock::now();
+
+    static OperationMetrics &instance()
+    {
+        static OperationMetrics metrics;
+        return metrics;
+    }
+
+    static Shard &localShard()
+    {
+        thread_local Shard *shard = nullptr;
+        if (!shard)
+        {
+            OperationMetrics &metrics = instance();
+            lock_guard<mutex> guard(metrics.lock);
+            metrics.shards.emplace_back(new Shard());
+            shard = metrics.shards.back().get();
+        }
+        return *shard;
+    }
+
+    static void add(atomic<uint64_t> &counter, uint64_t amount)
+    {
+        counter.store(counter.load(memory_order_relaxed) + amount, memory_order_relaxed);
+    }
 
 public:
-    void pushAction(const string &action)
+    struct Summary
     {
-        actions.push(action);
+        uint64_t count;
+        uint64_t p50, p99, p999, maximum;
+        double mean;
+        double perSecond;
+    };
+
+    static void record(Metric metric, uint64_t nanoseconds)
+    {
+        Shard &shard = localShard();
+        int m = (int)metric;
+        add(shard.buckets[m][LatencyBuckets::of(nanoseconds)], 1);
+        add(shard.totalNanoseconds[m], nanoseconds);
+        if (nanoseconds > shard.maximum[m].load(memory_order_relaxed))
+            shard.maximum[m].store(nanoseconds, memory_order_relaxed);
     }
 
-    string popAction()
+    // Percentiles report the top of their bucket. perSecond is over the
+    // whole process lifetime.
+    static Summary summarize(Metric metric)
     {
-        if (!actions.empty())
+        OperationMetrics &metrics = instance();
+        vector<uint64_t> merged(LatencyBuckets::count, 0);
+        Summary summary = {0, 0, 0, 0, 0, 0, 0};
+        uint64_t total = 0;
+        int m = (int)metric;
         {
-            string action = actions.top();
-            actions.pop();
-            return action;
+            lock_guard<mutex> guard(metrics.lock);
+            for (const unique_ptr<Shard> &shard : metrics.shards)
+            {
+                for (int b = 0; b < LatencyBuckets::count; b++)
+                    merged[b] += shard->buckets[m][b].load(memory_order_relaxed);
+                total += shard->totalNanoseconds[m].load(memory_order_relaxed);
+                summary.maximum = max(summary.maximum, shard->maximum[m].load(memory_order_relaxed));
+            }
         }
-        return "No actions to undo.";
+        for (uint64_t bucket : merged)
+            summary.count += bucket;
+        if (summary.count == 0)
+            return summary;
+
+        uint64_t *targets[3] = {&summary.p50, &summary.p99, &summary.p999};
+        const double quantiles[3] = {0.50, 0.99, 0.999};
+        uint64_t seen = 0;
+        int next = 0;
+        for (int b = 0; b < LatencyBuckets::count && next < 3; b++)
+        {
+            seen += merged[b];
+            while (next < 3 && seen >= (uint64_t)ceil(quantiles[next] * summary.count))
+                *targets[next++] = min(LatencyBuckets::highest(b), summary.maximum);
+        }
+        summary.mean = (double)total / summary.count;
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - metrics.started).count();
+        summary.perSecond = summary.count / max(seconds, 1e-9);
+        return summary;
     }
 
-    void displayActions()
+    static void display()
     {
-        stack<string> temp = actions;
-        if (temp.empty())
+        cout << "Operation     |      count |   p50 (us) |   p99 (us) |  p999 (us) |   max (us) |    ops/s\n";
+        for (int m = 0; m < metricCount; m++)
         {
-            cout << "No actions recorded." << endl;
-            return;
+            Summary s = summarize((Metric)m);
+            cout << left << setw(13) << metricName((Metric)m) << right << " | " << setw(10) << s.count << fixed
+                 << setprecision(1) << " | " << setw(10) << s.p50 / 1e3 << " | " << setw(10) << s.p99 / 1e3 << " | "
+                 << setw(10) << s.p999 / 1e3 << " | " << setw(10) << s.maximum / 1e3 << " | " << setw(8)
+                 << s.perSecond << defaultfloat << setprecision(6) << "\n";
         }
-        cout << "Action History:" << endl;
-        while (!temp.empty())
+    }
+
+    // One JSON object per operation, latencies in nanoseconds.
+    static void writeJson(ostream &out)
+    {
+        long long now = (long long)time(nullptr);
+        for (int m = 0; m < metricCount; m++)
         {
-            cout << temp.top() << endl;
-            temp.pop();
+            Summary s = summarize((Metric)m);
+            out << "{\"time\":" << now << ",\"operation\":\"" << metricName((Metric)m) << "\",\"count\":" << s.count << ",\"p50Ns\":" << s.p50
+                << ",\"p99Ns\":" << s.p99 << ",\"p999Ns\":" << s.p999 << ",\"maxNs\":" << s.maximum << fixed
+                << setprecision(1) << ",\"meanNs\":" << s.mean << ",\"perSecond\":" << setprecision(3) << s.perSecond
+                << "}" << defaultfloat << setprecision(6) << "\n";
         }
     }
+};
 
-    bool isEmpty() const
+// Records the lifetime of a scope under one metric.
+class OperationTimer
+{
+    Metric metric;
+    chrono::steady_clock::time_point started;
+
+public:
+    explicit OperationTimer(Metric metric) : metric(metric), started(chrono::steady_clock::now()) {}
+
+    OperationTimer(const OperationTimer &) = delete;
+    OperationTimer &operator=(const OperationTimer &) = delete;
+
+    ~OperationTimer()
     {
-        return actions.empty();
+        auto elapsed = chrono::steady_clock::now() - started;
+        OperationMetrics::record(metric, (uint64_t)chrono::duration_cast<chrono::nanoseconds>(elapsed).count());
     }
 };
 
-class Graph
+// Snapshot files hold the whole system state: a fixed header, a table of
+// sections, then the sections. Every section and every array inside one
+// starts on an 8-byte boundary, so arrays are read out of the mapping with
+// aligned bulk copies instead of being parsed. Loading still copies them
+// and rebuilds names and indexes (the fleet and inventory re-add every
+// entry), and that is deliberate: all of this state changes after load,
+// and serving it from a read-only mapping would mean copy-on-write layers
+// throughout the containers for a start-up cost paid once.
+enum class SnapshotSection : uint32_t
+{
+    Fleet = 1,
+    Inventory,
+    Locations,
+    Waitlist,
+    Actions,
+    Branches,
+    Log,
+    Dispatch
+};
+
+struct SnapshotHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t sectionCount;
+    uint64_t payloadSize;
+    uint64_t checksum;
+};
+
+struct SnapshotSectionEntry
+{
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+};
+
+const char snapshotMagic[8] = {'C', 'A', 'R', 'S', 'N', 'A', 'P', '\0'};
+const uint32_t snapshotVersion = 2;
+const uint32_t snapshotByteOrder = 0x01020304;
+
+// 64-bit multiply-rotate hash over 8-byte words; detects torn or corrupted
+// files, it is not meant to resist tampering.
+inline uint64_t snapshotChecksum(const char *data, size_t size)
+{
+    uint64_t hash = 0x9E3779B97F4A7C15ull ^ size;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        hash = ((hash << 31) | (hash >> 33)) ^ word;
+        hash *= 0x87C37B91114253D5ull;
+    }
+    for (; i < size; i++)
+        hash = (hash ^ (unsigned char)data[i]) * 0x100000001B3ull;
+    return hash ^ (hash >> 29);
+}
+
+class SnapshotWriter
 {
-    unordered_map<string, vector<pair<string, int>>> adjacencyList;
+    string buffer;
+    vector<SnapshotSectionEntry> sections;
 
 public:
-    void addEdge(const string &from, const string &to, int weight)
+    void align()
     {
-        adjacencyList[from].emplace_back(to, weight);
-        adjacencyList[to].emplace_back(from, weight);
+        buffer.resize((buffer.size() + 7) & ~size_t(7), '\0');
     }
 
-    void displayLocations()
+    void beginSection(SnapshotSection type)
     {
-        cout << "Rental Locations and Distances:" << endl;
-        for (const auto &location : adjacencyList)
+        align();
+        sections.push_back(SnapshotSectionEntry{(uint32_t)type, 0, buffer.size(), 0});
+    }
+
+    void endSection()
+    {
+        sections.back().size = buffer.size() - sections.back().offset;
+    }
+
+    template <typename T>
+    void put(const T &value)
+    {
+        buffer.append((const char *)&value, sizeof(T));
+    }
+
+    template <typename T>
+    void putArray(const T *values, size_t count)
+    {
+        align();
+        buffer.append((const char *)values, sizeof(T) * count);
+    }
+
+    template <typename T>
+    void putVector(const vector<T> &values)
+    {
+        put<uint64_t>(values.size());
+        putArray(values.data(), values.size());
+    }
+
+    void putString(string_view text)
+    {
+        put<uint32_t>((uint32_t)text.size());
+        buffer.append(text.data(), text.size());
+    }
+
+    // Writes to a temporary file and renames it over path, so a crash
+    // mid-save leaves the previous snapshot intact.
+    bool save(const string &path)
+    {
+        align();
+        size_t tableSize = sections.size() * sizeof(SnapshotSectionEntry);
+        for (SnapshotSectionEntry &entry : sections)
+            entry.offset += sizeof(SnapshotHeader) + tableSize;
+        string payload((const char *)sections.data(), tableSize);
+        payload += buffer;
+
+        SnapshotHeader header;
+        memcpy(header.magic, snapshotMagic, sizeof(header.magic));
+        header.version = snapshotVersion;
+        header.byteOrder = snapshotByteOrder;
+        header.sectionCount = sections.size();
+        header.payloadSize = payload.size();
+        header.checksum = snapshotChecksum(payload.data(), payload.size());
+
+        string temporary = path + ".tmp";
         {
-            cout << location.first << " -> ";
-            for (const auto &neighbor : location.second)
-            {
-                cout << neighbor.first << " (" << neighbor.second << " units), ";
-            }
-            cout << endl;
+            ofstream out(temporary, ios::binary | ios::trunc);
+            out.write((const char *)&header, sizeof(header));
+            out.write(payload.data(), payload.size());
+            if (!out.flush())
+                return false;
         }
+        if (!syncFileToDisk(temporary))
+            return false;
+#ifdef _WIN32
+        remove(path.c_str());
+#endif
+        return rename(temporary.c_str(), path.c_str()) == 0;
     }
+};
 
-    int shortestPath(const string &start, const string &end)
+// Bounds-checked reads from one section. Any overrun marks the cursor failed
+// and returns zeros, so readers check ok() once at the end.
+class SnapshotCursor
+{
+    const char *data;
+    size_t size;
+    size_t position;
+    bool failed;
+
+    bool need(size_t bytes)
+    {
+        if (failed || bytes > size - position)
+            failed = true;
+        return !failed;
+    }
+
+public:
+    SnapshotCursor(const char *data = nullptr, size_t size = 0) : data(data), size(size), position(0), failed(false) {}
+
+    template <typename T>
+    T get()
     {
-        unordered_map<string, int> distances;
-        for (const auto &node : adjacencyList)
+        T value{};
+        if (need(sizeof(T)))
         {
-            distances[node.first] = numeric_limits<int>::max();
+            memcpy(&value, data + position, sizeof(T));
+            position += sizeof(T);
         }
-        distances[start] = 0;
-
-        priority_queue<pair<int, string>, vector<pair<int, string>>, greater<>> pq;
-        pq.push({0, start});
+        return value;
+    }
 
-        while (!pq.empty())
+    // Points into the mapping; the snapshot must stay open while it is used.
+    template <typename T>
+    const T *array(size_t count)
+    {
+        position = min(size, (position + 7) & ~size_t(7));
+        if (count > (size - position) / sizeof(T) || !need(sizeof(T) * count))
         {
-            auto top = pq.top();
-            int currentDistance = top.first;
-            string currentNode = top.second;
-            pq.pop();
+            failed = true;
+            return nullptr;
+        }
+        const T *values = (const T *)(data + position);
+        position += sizeof(T) * count;
+        return values;
+    }
 
-            if (currentNode == end)
-                return currentDistance;
+    // Copies a putVector() array; the one fix-up for state kept in vectors.
+    template <typename T>
+    bool getVector(vector<T> &values)
+    {
+        uint64_t count = get<uint64_t>();
+        const T *first = array<T>(count);
+        if (!first)
+            return false;
+        values.assign(first, first + count);
+        return true;
+    }
 
-            for (const auto &neighbor : adjacencyList[currentNode])
-            {
-                string nextNode = neighbor.first;
-                int weight = neighbor.second;
-                int distance = currentDistance + weight;
+    string_view getString()
+    {
+        uint32_t length = get<uint32_t>();
+        if (!need(length))
+            return string_view();
+        string_view text(data + position, length);
+        position += length;
+        return text;
+    }
 
-                if (distance < distances[nextNode])
-                {
-                    distances[nextNode] = distance;
-                    pq.push({distance, nextNode});
-                }
-            }
+    bool ok() const
+    {
+        return !failed;
+    }
+};
+
+class SnapshotReader
+{
+    MappedFile file;
+    const SnapshotSectionEntry *sections;
+    size_t sectionCount;
+
+public:
+    SnapshotReader() : sections(nullptr), sectionCount(0) {}
+
+    // Maps path and checks magic, version, byte order, size and checksum.
+    bool open(const string &path)
+    {
+        sectionCount = 0;
+        if (!file.open(path))
+            return false;
+        SnapshotHeader header;
+        if (file.size() < sizeof(header))
+            return false;
+        memcpy(&header, file.data(), sizeof(header));
+        const char *payload = file.data() + sizeof(header);
+        if (memcmp(header.magic, snapshotMagic, sizeof(header.magic)) != 0 || header.version != snapshotVersion ||
+            header.byteOrder != snapshotByteOrder || header.payloadSize != file.size() - sizeof(header) ||
+            header.sectionCount > header.payloadSize / sizeof(SnapshotSectionEntry) ||
+            snapshotChecksum(payload, header.payloadSize) != header.checksum)
+        {
+            file.close();
+            return false;
         }
-        return -1;
+        sections = (const SnapshotSectionEntry *)payload;
+        sectionCount = header.sectionCount;
+        return true;
     }
-    void findShortestPath(const string &source, const string &destination)
+
+    void close()
     {
-        priority_queue<pair<int, string>, vector<pair<int, string>>, greater<>> pq;
-        unordered_map<string, int> distances;
-        unordered_map<string, string> previous;
+        file.close();
+        sectionCount = 0;
+    }
 
-        for (const auto &node : adjacencyList)
+    bool section(SnapshotSection type, SnapshotCursor &cursor) const
+    {
+        for (size_t i = 0; i < sectionCount; i++)
         {
-            distances[node.first] = INT_MAX;
+            const SnapshotSectionEntry &entry = sections[i];
+            if (entry.type != (uint32_t)type)
+                continue;
+            if (entry.offset > file.size() || entry.size > file.size() - entry.offset)
+                return false;
+            cursor = SnapshotCursor(file.data() + entry.offset, entry.size);
+            return true;
         }
-        distances[source] = 0;
-        previous[source] = ""; 
+        return false;
+    }
+};
 
-        pq.push({0, source});
+enum class LogRecordType : uint8_t
+{
+    Register = 1,
+    Reserve,
+    Return,
+    AddEdge
+};
 
-        while (!pq.empty())
-        {
-            pair<int, string> top = pq.top();
-            int currentDist = top.first;
-            string currentNode = top.second;
-            pq.pop();
+// Write-ahead log of registrations, bookings, returns and road edits.
+// append() adds a record to an in-memory buffer under a short lock, inside
+// the same critical section as the change it describes, so records of one
+// car or graph come out in the order the changes happened. commit() makes
+// everything appended so far durable: the first thread to commit writes
+// and syncs the whole buffer while the others wait, so concurrent
+// operations share one sync. Each record is framed as body length and
+// checksum, then a sequence number, the type and the fields; recovery
+// stops at the first torn or corrupt record.
+//
+// Changes are applied before they are durable, so whoever logs a change
+// also registers how to take it back (undoIfLost) and any work that must
+// wait for durability (onceDurable). The commit that covers the thread's
+// records runs one list or the other. A failed write leaves the log failed
+// until a snapshot empties it through reset(); retrying the sync after an
+// error could report data durable that never reached the disk.
+class WriteAheadLog
+{
+    struct Outcome
+    {
+        vector<function<void()>> undo;
+        vector<function<void()>> then;
+        uint64_t lastSequence = 0;
+    };
 
-            if (currentDist > distances[currentNode])
-                continue;
+    mutex lock;
+    condition_variable synced;
+    string pending;
+    uint64_t appended = 0, durable = 0;
+    uint64_t fileBytes = 0;
+    bool syncing = false, failed = false, opened = false;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+#else
+    int fd = -1;
+#endif
 
-            for (const auto &neighborPair : adjacencyList[currentNode])
-            {
-                string neighbor = neighborPair.first;
-                int weight = neighborPair.second;
-                int newDist = currentDist + weight;
+    static int &deferDepth()
+    {
+        thread_local int depth = 0;
+        return depth;
+    }
 
-                if (newDist < distances[neighbor])
-                {
-                    distances[neighbor] = newDist;
-                    previous[neighbor] = currentNode;
-                    pq.push({newDist, neighbor});
-                }
-            }
-        }
+    static Outcome &outcome()
+    {
+        thread_local Outcome mine;
+        return mine;
+    }
 
-        if (distances[destination] == INT_MAX)
+    // Runs the follow-ups of the thread's logged changes in order if they
+    // are durable, otherwise their undos newest first.
+    static void settle(bool durable)
+    {
+        Outcome &mine = outcome();
+        vector<function<void()>> undo, then;
+        undo.swap(mine.undo);
+        then.swap(mine.then);
+        if (durable)
         {
-            cout << "No path found from " << source << " to " << destination << "!\n";
+            for (function<void()> &fn : then)
+                fn();
         }
         else
         {
-            cout << "Shortest path from " << source << " to " << destination << ":\n";
+            for (auto it = undo.rbegin(); it != undo.rend(); ++it)
+                (*it)();
+        }
+    }
 
-            stack<string> path;
-            for (string at = destination; at != ""; at = previous[at])
+    // Makes the records up to target durable; false if the log failed
+    // first.
+    bool sync(uint64_t target)
+    {
+        unique_lock<mutex> guard(lock);
+        while (durable < target && !failed)
+        {
+            if (syncing)
             {
-                path.push(at);
+                synced.wait(guard);
+                continue;
             }
-
-            while (!path.empty())
+            syncing = true;
+            string batch;
+            batch.swap(pending);
+            uint64_t last = appended;
+            guard.unlock();
+            bool written = opened && writeAndSync(batch);
+            guard.lock();
+            syncing = false;
+            if (written)
             {
-                cout << path.top();
-                path.pop();
-                if (!path.empty())
-                    cout << " -> ";
+                durable = max(durable, last);
+                fileBytes += batch.size();
+            }
+            else
+            {
+                // Every record not yet durable is undone by its thread, so
+                // none of it may reach the file, not even a partial write.
+                failed = true;
+                pending.clear();
+                if (opened)
+                    truncateTo(fileBytes);
             }
-            cout << "\nTotal Distance: " << distances[destination] << " km\n";
+            synced.notify_all();
         }
+        return durable >= target;
     }
-};
 
-class BookingHistory
-{
-    struct Node
+    template <typename T>
+    void putField(T value)
     {
-        string bookingDetails;
-        Node *next;
-        Node(const string &details) : bookingDetails(details), next(nullptr) {}
-    };
+        static_assert(is_integral<T>::value, "log fields are integers or strings");
+        pending.append((const char *)&value, sizeof(value));
+    }
 
-    Node *head;
+    void putField(string_view text)
+    {
+        putField((uint32_t)text.size());
+        pending.append(text.data(), text.size());
+    }
 
-public:
-    BookingHistory() : head(nullptr) {}
+    void putField(const string &text)
+    {
+        putField(string_view(text));
+    }
 
-    void addBooking(const string &details)
+    bool writeAndSync(const string &data)
     {
-        Node *newNode = new Node(details);
-        if (!head)
+#ifdef _WIN32
+        for (size_t written = 0; written < data.size();)
         {
-            head = newNode;
-            return;
+            DWORD chunk = 0;
+            if (!WriteFile(file, data.data() + written, (DWORD)min<size_t>(data.size() - written, 1 << 30), &chunk, nullptr))
+                return false;
+            written += chunk;
         }
-        Node *current = head;
-        while (current->next)
+        return FlushFileBuffers(file) != 0;
+#else
+        for (size_t written = 0; written < data.size();)
         {
-            current = current->next;
+            ssize_t chunk = ::write(fd, data.data() + written, data.size() - written);
+            if (chunk < 0 && errno == EINTR)
+                continue;
+            if (chunk <= 0)
+                return false;
+            written += (size_t)chunk;
         }
-        current->next = newNode;
+#ifdef __linux__
+        return fdatasync(fd) == 0;
+#else
+        return fsync(fd) == 0;
+#endif
+#endif
     }
 
-    void displayHistory() const
+    // Cuts the file to length bytes and appends from there.
+    bool truncateTo(uint64_t length)
     {
-        Node *current = head;
-        if (!current)
-        {
-            cout << "No booking history available." << endl;
-            return;
-        }
-        cout << "Booking History:" << endl;
-        while (current)
+#ifdef _WIN32
+        LARGE_INTEGER position;
+        position.QuadPart = (LONGLONG)length;
+        return SetFilePointerEx(file, position, nullptr, FILE_BEGIN) && SetEndOfFile(file) && FlushFileBuffers(file);
+#else
+        return ftruncate(fd, (off_t)length) == 0 && lseek(fd, (off_t)length, SEEK_SET) == (off_t)length &&
+               fsync(fd) == 0;
+#endif
+    }
+
+public:
+    static const size_t frameBytes = 2 * sizeof(uint32_t);
+
+    WriteAheadLog() {}
+    WriteAheadLog(const WriteAheadLog &) = delete;
+    WriteAheadLog &operator=(const WriteAheadLog &) = delete;
+
+    ~WriteAheadLog()
+    {
+        sync(lastSequence());
+        close();
+    }
+
+    // Calls fn(sequence, type, fields) for each intact record of the log at
+    // path. validBytes receives the length of the intact prefix and
+    // lastSequence the highest sequence number seen. Returns the record count.
+    template <typename Fn>
+    static size_t replay(const string &path, Fn fn, uint64_t &validBytes, uint64_t &lastSequence)
+    {
+        MappedFile log;
+        size_t count = 0;
+        validBytes = 0;
+        lastSequence = 0;
+        if (!log.open(path))
+            return 0;
+        const char *data = log.data();
+        size_t size = log.size();
+        while (size - validBytes >= frameBytes)
+        {
+            uint32_t length, checksum;
+            memcpy(&length, data + validBytes, sizeof(length));
+            memcpy(&checksum, data + validBytes + sizeof(length), sizeof(checksum));
+            const char *body = data + validBytes + frameBytes;
+            if (length < sizeof(uint64_t) + 1 || length > size - validBytes - frameBytes ||
+                (uint32_t)snapshotChecksum(body, length) != checksum)
+                break;
+            uint64_t sequence;
+            memcpy(&sequence, body, sizeof(sequence));
+            SnapshotCursor fields(body + sizeof(sequence) + 1, length - sizeof(sequence) - 1);
+            fn(sequence, (LogRecordType)body[sizeof(sequence)], fields);
+            lastSequence = max(lastSequence, sequence);
+            validBytes += frameBytes + length;
+            count++;
+        }
+        return count;
+    }
+
+    // Opens the log for appending after its first validBytes bytes, dropping
+    // any torn tail; new records are numbered from lastSequence + 1.
+    bool open(const string &path, uint64_t validBytes, uint64_t lastSequence)
+    {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS,
+                           FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+#else
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0)
+            return false;
+#endif
+        if (!truncateTo(validBytes))
+        {
+            close();
+            return false;
+        }
+        fileBytes = validBytes;
+        appended = durable = lastSequence;
+        failed = false;
+        opened = true;
+        return true;
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (fd >= 0)
+            ::close(fd);
+        fd = -1;
+#endif
+        opened = false;
+    }
+
+    bool isOpen() const
+    {
+        return opened;
+    }
+
+    // Buffers one record and returns its sequence number; integer fields are
+    // stored as-is, strings with a 32-bit length. Once the log has failed
+    // nothing is buffered and the commit reports the change lost.
+    template <typename... Fields>
+    uint64_t append(LogRecordType type, const Fields &...fields)
+    {
+        lock_guard<mutex> guard(lock);
+        uint64_t sequence = outcome().lastSequence = ++appended;
+        if (failed)
+            return sequence;
+        size_t start = pending.size();
+        pending.append(frameBytes, '\0');
+        putField(sequence);
+        putField((uint8_t)type);
+        (putField(fields), ...);
+        uint32_t length = (uint32_t)(pending.size() - start - frameBytes);
+        uint32_t checksum = (uint32_t)snapshotChecksum(pending.data() + start + frameBytes, length);
+        memcpy(&pending[start], &length, sizeof(length));
+        memcpy(&pending[start + sizeof(length)], &checksum, sizeof(checksum));
+        return sequence;
+    }
+
+    // Returns once every record the thread appended is on disk, then runs
+    // its follow-ups; if the log could not be written it runs their
+    // undos instead and returns false. Inside a DeferredCommit scope it
+    // returns at once and the scope commits on exit.
+    bool commit()
+    {
+        if (deferDepth() > 0)
+            return true;
+        bool ok = sync(outcome().lastSequence);
+        settle(ok);
+        return ok;
+    }
+
+    // Registers how to take back a change the current thread just logged.
+    static void undoIfLost(function<void()> undo)
+    {
+        outcome().undo.push_back(move(undo));
+    }
+
+    // Registers work to do once the current thread's changes are durable.
+    static void onceDurable(function<void()> then)
+    {
+        outcome().then.push_back(move(then));
+    }
+
+    static bool deferring()
+    {
+        return deferDepth() > 0;
+    }
+
+    static bool hasUnsettled()
+    {
+        return !outcome().undo.empty() || !outcome().then.empty();
+    }
+
+    // Sequence number of the current thread's latest record.
+    static uint64_t lastAppendedByThread()
+    {
+        return outcome().lastSequence;
+    }
+
+    bool hasFailed()
+    {
+        lock_guard<mutex> guard(lock);
+        return failed;
+    }
+
+    // Empties the log once a snapshot holds everything it recorded, which
+    // also clears an earlier write failure. The caller must make sure no
+    // changes are in flight.
+    bool reset()
+    {
+        unique_lock<mutex> guard(lock);
+        synced.wait(guard, [this]()
+                    { return !syncing; });
+        pending.clear();
+        durable = appended;
+        fileBytes = 0;
+        bool emptied = !opened || truncateTo(0);
+        if (emptied)
+            failed = false;
+        synced.notify_all();
+        return emptied;
+    }
+
+    uint64_t lastSequence()
+    {
+        lock_guard<mutex> guard(lock);
+        return appended;
+    }
+
+    // Bytes on disk plus bytes waiting to be committed.
+    uint64_t size()
+    {
+        lock_guard<mutex> guard(lock);
+        return fileBytes + pending.size();
+    }
+
+    // Batches the commits of everything the current thread does while it
+    // exists into one, made by finish() or when it goes out of scope.
+    class DeferredCommit
+    {
+        WriteAheadLog &log;
+        bool finished = false, outermost = false, settled = false;
+        bool durable = true;
+
+    public:
+        explicit DeferredCommit(WriteAheadLog &log) : log(log)
+        {
+            deferDepth()++;
+        }
+
+        DeferredCommit(const DeferredCommit &) = delete;
+        DeferredCommit &operator=(const DeferredCommit &) = delete;
+
+        // Ends the scope and commits; false if the records could not be
+        // made durable. A nested scope leaves that to the outermost one.
+        // The undos or follow-ups wait for settle(), so the caller can run
+        // them under the lock they need.
+        bool finish()
+        {
+            if (!finished)
+            {
+                finished = true;
+                outermost = --deferDepth() == 0;
+                durable = !outermost || log.sync(outcome().lastSequence);
+            }
+            return durable;
+        }
+
+        void settle()
+        {
+            finish();
+            if (outermost && !settled)
+            {
+                settled = true;
+                WriteAheadLog::settle(durable);
+            }
+        }
+
+        ~DeferredCommit()
+        {
+            settle();
+        }
+    };
+};
+
+// Bounded lock-free multi-producer/multi-consumer waitlist (Vyukov's
+// sequence-numbered ring). Each slot's sequence says whether it is free for
+// the producer at that position or holds a customer for the consumer.
+class ConcurrentWaitlist
+{
+    struct alignas(64) Slot
+    {
+        atomic<size_t> sequence;
+        string customer;
+    };
+
+    unique_ptr<Slot[]> slots;
+    size_t mask;
+    alignas(64) atomic<size_t> enqueuePos;
+    alignas(64) atomic<size_t> dequeuePos;
+
+    static intptr_t distance(size_t sequence, size_t position)
+    {
+        return (intptr_t)(sequence - position);
+    }
+
+public:
+    explicit ConcurrentWaitlist(size_t capacity = 1024) : enqueuePos(0), dequeuePos(0)
+    {
+        size_t size = 2;
+        while (size < capacity)
+            size *= 2;
+        slots.reset(new Slot[size]);
+        mask = size - 1;
+        for (size_t i = 0; i < size; i++)
+            slots[i].sequence.store(i, memory_order_relaxed);
+    }
+
+    ConcurrentWaitlist(const ConcurrentWaitlist &) = delete;
+    ConcurrentWaitlist &operator=(const ConcurrentWaitlist &) = delete;
+
+    size_t capacity() const
+    {
+        return mask + 1;
+    }
+
+    // Returns false when the waitlist is full.
+    bool enqueue(const string &customer)
+    {
+        size_t position = enqueuePos.load(memory_order_relaxed);
+        for (;;)
+        {
+            Slot &slot = slots[position & mask];
+            intptr_t diff = distance(slot.sequence.load(memory_order_acquire), position);
+            if (diff == 0)
+            {
+                if (enqueuePos.compare_exchange_weak(position, position + 1, memory_order_relaxed))
+                {
+                    slot.customer = customer;
+                    slot.sequence.store(position + 1, memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = enqueuePos.load(memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryDequeue(string &customer)
+    {
+        size_t position = dequeuePos.load(memory_order_relaxed);
+        for (;;)
+        {
+            Slot &slot = slots[position & mask];
+            intptr_t diff = distance(slot.sequence.load(memory_order_acquire), position + 1);
+            if (diff == 0)
+            {
+                if (dequeuePos.compare_exchange_weak(position, position + 1, memory_order_relaxed))
+                {
+                    customer = move(slot.customer);
+                    slot.sequence.store(position + mask + 1, memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = dequeuePos.load(memory_order_relaxed);
+            }
+        }
+    }
+
+    string dequeue()
+    {
+        string customer;
+        if (tryDequeue(customer))
+            return customer;
+        return "Waitlist is empty.";
+    }
+
+    // Claims up to maxCount consecutive published customers with a single
+    // CAS and appends them to out. Returns the number dequeued.
+    size_t dequeueBatch(vector<string> &out, size_t maxCount)
+    {
+        size_t position = dequeuePos.load(memory_order_relaxed);
+        for (;;)
+        {
+            size_t ready = 0;
+            while (ready < maxCount && ready <= mask &&
+                   distance(slots[(position + ready) & mask].sequence.load(memory_order_acquire), position + ready + 1) == 0)
+                ready++;
+            if (ready == 0)
+                return 0;
+            if (!dequeuePos.compare_exchange_weak(position, position + ready, memory_order_relaxed))
+                continue;
+
+            for (size_t i = 0; i < ready; i++)
+            {
+                Slot &slot = slots[(position + i) & mask];
+                out.push_back(move(slot.customer));
+                slot.sequence.store(position + i + mask + 1, memory_order_release);
+            }
+            return ready;
+        }
+    }
+
+    // Visits waiting customers in order without copying the queue. Producers
+    // may keep enqueuing, but no other thread may dequeue meanwhile, so call
+    // it from the consumer (dispatcher) side.
+    template <typename Fn>
+    void forEachWaiting(Fn fn) const
+    {
+        size_t end = enqueuePos.load(memory_order_acquire);
+        for (size_t position = dequeuePos.load(memory_order_acquire); position != end; position++)
+        {
+            const Slot &slot = slots[position & mask];
+            if (distance(slot.sequence.load(memory_order_acquire), position + 1) != 0)
+                break;
+            fn(slot.customer);
+        }
+    }
+
+    // Same format as the single-threaded waitlist it replaced. Like
+    // forEachWaiting, only while nothing dequeues.
+    void writeSnapshot(SnapshotWriter &out) const
+    {
+        size_t count = 0;
+        forEachWaiting([&count](const string &)
+        {
+            count++;
+        });
+        out.put<uint64_t>(count);
+        forEachWaiting([&](const string &customer)
+        {
+            if (count > 0)
+            {
+                out.putString(customer);
+                count--;
+            }
+        });
+    }
+
+    bool readSnapshot(SnapshotCursor &in)
+    {
+        uint64_t count = in.get<uint64_t>();
+        for (uint64_t i = 0; i < count && in.ok(); i++)
+        {
+            if (!enqueue(string(in.getString())))
+                return false;
+        }
+        return in.ok();
+    }
+
+    void displayWaitlist() const
+    {
+        if (isEmpty())
+        {
+            cout << "Waitlist is empty." << endl;
+            return;
+        }
+        cout << "Waitlist:" << endl;
+        forEachWaiting([](const string &customer)
+        {
+            cout << customer << endl;
+        });
+    }
+
+    bool isEmpty() const
+    {
+        size_t position = dequeuePos.load(memory_order_acquire);
+        return distance(slots[position & mask].sequence.load(memory_order_acquire), position + 1) < 0;
+    }
+};
+
+class ActionStack
+{
+    stack<string> actions;
+
+public:
+    void pushAction(const string &action)
+    {
+        actions.push(action);
+    }
+
+    string popAction()
+    {
+        if (!actions.empty())
+        {
+            string action = actions.top();
+            actions.pop();
+            return action;
+        }
+        return "No actions to undo.";
+    }
+
+    void displayActions()
+    {
+        stack<string> temp = actions;
+        if (temp.empty())
+        {
+            cout << "No actions recorded." << endl;
+            return;
+        }
+        cout << "Action History:" << endl;
+        while (!temp.empty())
+        {
+            cout << temp.top() << endl;
+            temp.pop();
+        }
+    }
+
+    bool isEmpty() const
+    {
+        return actions.empty();
+    }
+
+    // Bottom of the stack first, so reading pushes them back in order.
+    void writeSnapshot(SnapshotWriter &out) const
+    {
+        stack<string> temp = actions;
+        vector<string> bottomUp;
+        for (; !temp.empty(); temp.pop())
+            bottomUp.push_back(temp.top());
+        out.put<uint64_t>(bottomUp.size());
+        for (auto it = bottomUp.rbegin(); it != bottomUp.rend(); ++it)
+            out.putString(*it);
+    }
+
+    bool readSnapshot(SnapshotCursor &in)
+    {
+        uint64_t count = in.get<uint64_t>();
+        for (uint64_t i = 0; i < count && in.ok(); i++)
+            actions.push(string(in.getString()));
+        return in.ok();
+    }
+};
+
+// Dense row-major distance table; -1 marks an unreachable pair.
+struct DistanceMatrix
+{
+    size_t rows = 0;
+    size_t cols = 0;
+    vector<int> values;
+
+    int at(size_t row, size_t col) const
+    {
+        return values[row * cols + col];
+    }
+};
+
+enum class ShortestPathEngine
+{
+    Dijkstra,
+    DeltaStepping
+};
+
+// Location names are interned to dense ids once; edges are staged as they are
+// added and frozen into a compressed-sparse-row adjacency on the next query.
+// Dijkstra then runs over flat int arrays using a per-thread workspace whose
+// entries are invalidated by a generation stamp instead of being cleared.
+class Graph
+{
+    struct Edge
+    {
+        int from;
+        int to;
+        int weight;
+    };
+
+    struct Workspace
+    {
+        vector<int> distance;
+        vector<int> previous;
+        vector<unsigned> stamp;
+        vector<pair<int, int>> heap;
+        unsigned generation = 0;
+
+        void reset(size_t nodeCount)
+        {
+            if (stamp.size() < nodeCount)
+            {
+                distance.resize(nodeCount);
+                previous.resize(nodeCount);
+                stamp.resize(nodeCount, 0);
+            }
+            if (++generation == 0)
+            {
+                fill(stamp.begin(), stamp.end(), 0);
+                generation = 1;
+            }
+            heap.clear();
+        }
+
+        int dist(int node) const
+        {
+            return stamp[node] == generation ? distance[node] : INT_MAX;
+        }
+
+        void set(int node, int dist, int from)
+        {
+            stamp[node] = generation;
+            distance[node] = dist;
+            previous[node] = from;
+        }
+    };
+
+    unordered_map<string, int> idByName;
+    vector<string> names;
+    vector<Edge> edges;
+
+    vector<int> offsets;
+    vector<int> targets;
+    vector<int> weights;
+    bool frozen = true;
+
+    // Contraction hierarchy: every node gets a rank and keeps only the edges
+    // (original or shortcut) leading to higher-ranked nodes. A shortcut
+    // records the contracted middle node so paths can be unpacked.
+    struct UpEdge
+    {
+        int to;
+        int weight;
+        int middle;
+    };
+
+    ShortestPathEngine engine = ShortestPathEngine::Dijkstra;
+    unsigned engineThreads = 0;
+    int bucketWidth = 0;
+    int delta = 1;
+    WriteAheadLog *log = nullptr;
+
+    bool useHierarchy = false;
+    bool hierarchyBuilt = false;
+    vector<int> rankOf;
+    vector<int> upOffsets;
+    vector<UpEdge> upEdges;
+
+    static Workspace &workspace(int which = 0)
+    {
+        thread_local Workspace ws[2];
+        return ws[which];
+    }
+
+    int intern(const string &name)
+    {
+        auto it = idByName.find(name);
+        if (it != idByName.end())
+            return it->second;
+        int id = (int)names.size();
+        idByName.emplace(name, id);
+        names.push_back(name);
+        return id;
+    }
+
+    void freeze()
+    {
+        if (frozen)
+            return;
+        size_t nodeCount = names.size();
+        offsets.assign(nodeCount + 1, 0);
+        for (const Edge &edge : edges)
+        {
+            offsets[edge.from + 1]++;
+            offsets[edge.to + 1]++;
+        }
+        for (size_t i = 0; i < nodeCount; i++)
+            offsets[i + 1] += offsets[i];
+
+        targets.resize(offsets[nodeCount]);
+        weights.resize(offsets[nodeCount]);
+        vector<int> cursor(offsets.begin(), offsets.end() - 1);
+        for (const Edge &edge : edges)
+        {
+            targets[cursor[edge.from]] = edge.to;
+            weights[cursor[edge.from]++] = edge.weight;
+            targets[cursor[edge.to]] = edge.from;
+            weights[cursor[edge.to]++] = edge.weight;
+        }
+        frozen = true;
+        chooseDelta();
+    }
+
+    // Delta-stepping's bucket width: the requested one, or else max road
+    // length / average degree. Set whenever the adjacency changes, so
+    // queries only read it.
+    void chooseDelta()
+    {
+        if (bucketWidth > 0)
+        {
+            delta = bucketWidth;
+            return;
+        }
+        int maxWeight = 1;
+        for (int weight : weights)
+            maxWeight = max(maxWeight, weight);
+        long long degree = max<long long>(1, (long long)weights.size() / max<size_t>(1, names.size()));
+        delta = (int)max<long long>(1, maxWeight / degree);
+    }
+
+    // Bounded Dijkstra from source over uncontracted nodes, skipping `skip`.
+    // Giving up early only costs an unnecessary shortcut, never correctness.
+    static void witnessSearch(const vector<vector<UpEdge>> &adjacency, const vector<char> &contracted,
+                              int source, int skip, int limit, Workspace &ws)
+    {
+        const int maxSettled = 500;
+        ws.reset(adjacency.size());
+        ws.set(source, 0, -1);
+        ws.heap.push_back({0, source});
+        int settled = 0;
+
+        while (!ws.heap.empty() && settled < maxSettled)
+        {
+            pop_heap(ws.heap.begin(), ws.heap.end(), greater<>());
+            pair<int, int> top = ws.heap.back();
+            ws.heap.pop_back();
+            if (top.first > ws.dist(top.second))
+                continue;
+            if (top.first > limit)
+                break;
+            settled++;
+            for (const UpEdge &edge : adjacency[top.second])
+            {
+                if (edge.to == skip || contracted[edge.to])
+                    continue;
+                int newDist = top.first + edge.weight;
+                if (newDist < ws.dist(edge.to))
+                {
+                    ws.set(edge.to, newDist, top.second);
+                    ws.heap.push_back({newDist, edge.to});
+                    push_heap(ws.heap.begin(), ws.heap.end(), greater<>());
+                }
+            }
+        }
+    }
+
+    // Counts (or, when apply is set, inserts) the shortcuts needed to remove
+    // node from the remaining graph.
+    static int contractNode(vector<vector<UpEdge>> &adjacency, const vector<char> &contracted,
+                            int node, bool apply, Workspace &ws)
+    {
+        vector<UpEdge> neighbours;
+        int maxWeight = 0;
+        for (const UpEdge &edge : adjacency[node])
+        {
+            if (!contracted[edge.to])
+            {
+                neighbours.push_back(edge);
+                maxWeight = max(maxWeight, edge.weight);
+            }
+        }
+
+        int shortcuts = 0;
+        for (size_t i = 0; i < neighbours.size(); i++)
+        {
+            const UpEdge &in = neighbours[i];
+            witnessSearch(adjacency, contracted, in.to, node, in.weight + maxWeight, ws);
+            for (size_t j = i + 1; j < neighbours.size(); j++)
+            {
+                const UpEdge &out = neighbours[j];
+                int viaNode = in.weight + out.weight;
+                if (ws.dist(out.to) <= viaNode)
+                    continue;
+                shortcuts++;
+                if (apply)
+                {
+                    addOrImprove(adjacency[in.to], out.to, viaNode, node);
+                    addOrImprove(adjacency[out.to], in.to, viaNode, node);
+                }
+            }
+        }
+        return shortcuts;
+    }
+
+    static void addOrImprove(vector<UpEdge> &edgesOfNode, int to, int weight, int middle)
+    {
+        for (UpEdge &edge : edgesOfNode)
+        {
+            if (edge.to == to)
+            {
+                if (weight < edge.weight)
+                {
+                    edge.weight = weight;
+                    edge.middle = middle;
+                }
+                return;
+            }
+        }
+        edgesOfNode.push_back({to, weight, middle});
+    }
+
+    void buildHierarchy()
+    {
+        freeze();
+        size_t nodeCount = names.size();
+        vector<vector<UpEdge>> adjacency(nodeCount);
+        for (size_t node = 0; node < nodeCount; node++)
+        {
+            for (int e = offsets[node]; e < offsets[node + 1]; e++)
+            {
+                if (targets[e] != (int)node)
+                    addOrImprove(adjacency[node], targets[e], weights[e], -1);
+            }
+        }
+
+        Workspace ws;
+        vector<char> contracted(nodeCount, 0);
+        vector<int> contractedNeighbours(nodeCount, 0);
+        auto priority = [&](int node)
+        {
+            int degree = 0;
+            for (const UpEdge &edge : adjacency[node])
+                degree += !contracted[edge.to];
+            return 2 * contractNode(adjacency, contracted, node, false, ws) - degree + contractedNeighbours[node];
+        };
+
+        priority_queue<pair<int, int>, vector<pair<int, int>>, greater<>> order;
+        for (size_t node = 0; node < nodeCount; node++)
+            order.push({priority((int)node), (int)node});
+
+        rankOf.assign(nodeCount, 0);
+        vector<vector<UpEdge>> upward(nodeCount);
+        int nextRank = 0;
+        while (!order.empty())
+        {
+            int node = order.top().second;
+            order.pop();
+            if (contracted[node])
+                continue;
+            int current = priority(node);
+            if (!order.empty() && current > order.top().first)
+            {
+                order.push({current, node});
+                continue;
+            }
+
+            contractNode(adjacency, contracted, node, true, ws);
+            for (const UpEdge &edge : adjacency[node])
+            {
+                if (!contracted[edge.to])
+                {
+                    upward[node].push_back(edge);
+                    contractedNeighbours[edge.to]++;
+                }
+            }
+            contracted[node] = 1;
+            rankOf[node] = nextRank++;
+            vector<UpEdge>().swap(adjacency[node]);
+        }
+
+        upOffsets.assign(nodeCount + 1, 0);
+        upEdges.clear();
+        for (size_t node = 0; node < nodeCount; node++)
+        {
+            upEdges.insert(upEdges.end(), upward[node].begin(), upward[node].end());
+            upOffsets[node + 1] = (int)upEdges.size();
+        }
+        hierarchyBuilt = true;
+    }
+
+    void ensureHierarchy()
+    {
+        freeze();
+        if (!hierarchyBuilt)
+            buildHierarchy();
+    }
+
+    // Bidirectional upward search; both directions use the same upward graph
+    // because every road is two-way. Returns the meeting node or -1.
+    int hierarchyQuery(int source, int target, Workspace &forward, Workspace &backward, int &best)
+    {
+        size_t nodeCount = names.size();
+        forward.reset(nodeCount);
+        backward.reset(nodeCount);
+        forward.set(source, 0, -1);
+        backward.set(target, 0, -1);
+        forward.heap.push_back({0, source});
+        backward.heap.push_back({0, target});
+        best = INT_MAX;
+        int meeting = -1;
+
+        Workspace *sides[2] = {&forward, &backward};
+        int side = 0;
+        while (!forward.heap.empty() || !backward.heap.empty())
+        {
+            Workspace &ws = *sides[side];
+            Workspace &other = *sides[1 - side];
+            side = 1 - side;
+            if (ws.heap.empty())
+                continue;
+            if (ws.heap.front().first >= best)
+            {
+                ws.heap.clear();
+                continue;
+            }
+
+            pop_heap(ws.heap.begin(), ws.heap.end(), greater<>());
+            pair<int, int> top = ws.heap.back();
+            ws.heap.pop_back();
+            int currentDist = top.first;
+            int currentNode = top.second;
+            if (currentDist > ws.dist(currentNode))
+                continue;
+
+            int otherDist = other.dist(currentNode);
+            if (otherDist != INT_MAX && currentDist + otherDist < best)
+            {
+                best = currentDist + otherDist;
+                meeting = currentNode;
+            }
+
+            for (int e = upOffsets[currentNode]; e < upOffsets[currentNode + 1]; e++)
+            {
+                const UpEdge &edge = upEdges[e];
+                int newDist = currentDist + edge.weight;
+                if (newDist < ws.dist(edge.to))
+                {
+                    ws.set(edge.to, newDist, currentNode);
+                    ws.heap.push_back({newDist, edge.to});
+                    push_heap(ws.heap.begin(), ws.heap.end(), greater<>());
+                }
+            }
+        }
+        return meeting;
+    }
+
+    int middleOf(int a, int b) const
+    {
+        int low = rankOf[a] < rankOf[b] ? a : b;
+        int high = low == a ? b : a;
+        for (int e = upOffsets[low]; e < upOffsets[low + 1]; e++)
+        {
+            if (upEdges[e].to == high)
+                return upEdges[e].middle;
+        }
+        return -1;
+    }
+
+    // Appends the original nodes after `from` up to and including `to`.
+    void unpackEdge(int from, int to, vector<int> &path) const
+    {
+        vector<pair<int, int>> pending = {{from, to}};
+        while (!pending.empty())
+        {
+            pair<int, int> edge = pending.back();
+            pending.pop_back();
+            int middle = middleOf(edge.first, edge.second);
+            if (middle < 0)
+            {
+                path.push_back(edge.second);
+                continue;
+            }
+            pending.push_back({middle, edge.second});
+            pending.push_back({edge.first, middle});
+        }
+    }
+
+    vector<int> hierarchyPath(int source, int target, int meeting, const Workspace &forward, const Workspace &backward) const
+    {
+        vector<int> upChain;
+        for (int at = meeting; at != -1; at = forward.previous[at])
+            upChain.push_back(at);
+        reverse(upChain.begin(), upChain.end());
+
+        vector<int> path = {source};
+        for (size_t i = 0; i + 1 < upChain.size(); i++)
+            unpackEdge(upChain[i], upChain[i + 1], path);
+        for (int at = meeting; at != target; at = backward.previous[at])
+            unpackEdge(at, backward.previous[at], path);
+        return path;
+    }
+
+    int dijkstra(int source, int target, Workspace &ws)
+    {
+        freeze();
+        ws.reset(names.size());
+        ws.set(source, 0, -1);
+        ws.heap.push_back({0, source});
+
+        while (!ws.heap.empty())
+        {
+            pop_heap(ws.heap.begin(), ws.heap.end(), greater<>());
+            pair<int, int> top = ws.heap.back();
+            ws.heap.pop_back();
+            int currentDist = top.first;
+            int currentNode = top.second;
+
+            if (currentDist > ws.dist(currentNode))
+                continue;
+            if (currentNode == target)
+                return currentDist;
+
+            for (int e = offsets[currentNode]; e < offsets[currentNode + 1]; e++)
+            {
+                int next = targets[e];
+                int newDist = currentDist + weights[e];
+                if (newDist < ws.dist(next))
+                {
+                    ws.set(next, newDist, currentNode);
+                    ws.heap.push_back({newDist, next});
+                    push_heap(ws.heap.begin(), ws.heap.end(), greater<>());
+                }
+            }
+        }
+        return INT_MAX;
+    }
+
+    // Delta-stepping keeps each node's tentative distance and predecessor
+    // packed in one 64-bit word so a compare-and-swap updates both together;
+    // the predecessor chain is therefore always a shortest path.
+    struct DeltaState
+    {
+        vector<atomic<uint64_t>> label;
+        vector<unsigned> queuedPhase;
+        vector<vector<int>> buckets;
+        vector<vector<pair<int, int>>> outboxes;
+        unsigned phase = 0;
+    };
+
+    static uint64_t packLabel(int distance, int previous)
+    {
+        return ((uint64_t)(uint32_t)distance << 32) | (uint32_t)previous;
+    }
+
+    static int labelDistance(uint64_t label)
+    {
+        return (int)(label >> 32);
+    }
+
+    static int labelPrevious(uint64_t label)
+    {
+        return (int)(uint32_t)label;
+    }
+
+    static bool relaxAtomic(atomic<uint64_t> &label, int distance, int previous)
+    {
+        uint64_t current = label.load(memory_order_relaxed);
+        uint64_t wanted = packLabel(distance, previous);
+        while (distance < labelDistance(current))
+        {
+            if (label.compare_exchange_weak(current, wanted, memory_order_relaxed))
+                return true;
+        }
+        return false;
+    }
+
+    // Relaxes the light (weight <= delta) or heavy edges of every node in
+    // frontier, in parallel blocks, and files improved nodes into buckets.
+    void relaxFrontier(const vector<int> &frontier, bool light, DeltaState &state, unsigned threads) const
+    {
+        const size_t blockSize = 256;
+        size_t blocks = (frontier.size() + blockSize - 1) / blockSize;
+        if (state.outboxes.size() < blocks)
+            state.outboxes.resize(blocks);
+
+        auto relaxBlock = [&](size_t block)
+        {
+            vector<pair<int, int>> &outbox = state.outboxes[block];
+            outbox.clear();
+            size_t last = min(frontier.size(), (block + 1) * blockSize);
+            for (size_t i = block * blockSize; i < last; i++)
+            {
+                int node = frontier[i];
+                int base = labelDistance(state.label[node].load(memory_order_relaxed));
+                for (int e = offsets[node]; e < offsets[node + 1]; e++)
+                {
+                    if ((weights[e] <= delta) != light)
+                        continue;
+                    int newDist = base + weights[e];
+                    if (relaxAtomic(state.label[targets[e]], newDist, node))
+                        outbox.push_back({targets[e], newDist});
+                }
+            }
+        };
+        if (frontier.size() >= 4 * blockSize)
+            parallelFor(blocks, threads, relaxBlock);
+        else
+            for (size_t block = 0; block < blocks; block++)
+                relaxBlock(block);
+
+        for (size_t block = 0; block < blocks; block++)
+        {
+            for (const pair<int, int> &improved : state.outboxes[block])
+            {
+                if (labelDistance(state.label[improved.first].load(memory_order_relaxed)) != improved.second)
+                    continue;
+                size_t bucket = improved.second / delta;
+                if (state.buckets.size() <= bucket)
+                    state.buckets.resize(bucket + 1);
+                state.buckets[bucket].push_back(improved.first);
+            }
+        }
+    }
+
+    int deltaStepping(int source, int target, vector<int> *path)
+    {
+        freeze();
+        thread_local DeltaState state;
+        size_t nodeCount = names.size();
+        if (state.label.size() < nodeCount)
+        {
+            state.label = vector<atomic<uint64_t>>(nodeCount);
+            state.queuedPhase.assign(nodeCount, 0);
+        }
+        for (size_t node = 0; node < nodeCount; node++)
+            state.label[node].store(packLabel(INT_MAX, -1), memory_order_relaxed);
+        for (vector<int> &bucket : state.buckets)
+            bucket.clear();
+
+        state.label[source].store(packLabel(0, -1), memory_order_relaxed);
+        state.buckets.resize(max<size_t>(state.buckets.size(), 1));
+        state.buckets[0].push_back(source);
+
+        vector<int> frontier, settled;
+        for (size_t current = 0; current < state.buckets.size(); current++)
+        {
+            settled.clear();
+            while (!state.buckets[current].empty())
+            {
+                if (++state.phase == 0)
+                {
+                    fill(state.queuedPhase.begin(), state.queuedPhase.end(), 0);
+                    state.phase = 1;
+                }
+                frontier.clear();
+                for (int node : state.buckets[current])
+                {
+                    int distance = labelDistance(state.label[node].load(memory_order_relaxed));
+                    if ((size_t)(distance / delta) == current && state.queuedPhase[node] != state.phase)
+                    {
+                        state.queuedPhase[node] = state.phase;
+                        frontier.push_back(node);
+                    }
+                }
+                state.buckets[current].clear();
+                settled.insert(settled.end(), frontier.begin(), frontier.end());
+                relaxFrontier(frontier, true, state, engineThreads);
+            }
+            relaxFrontier(settled, false, state, engineThreads);
+
+            if (target >= 0 && labelDistance(state.label[target].load(memory_order_relaxed)) / delta <= (int)current)
+                break;
+        }
+
+        int distance = labelDistance(state.label[target].load(memory_order_relaxed));
+        if (path && distance != INT_MAX)
+        {
+            for (int at = target; at != -1; at = labelPrevious(state.label[at].load(memory_order_relaxed)))
+                path->push_back(at);
+            reverse(path->begin(), path->end());
+        }
+        return distance;
+    }
+
+    // Plain Dijkstra from source that stops once every node flagged in
+    // isTarget has been settled.
+    void settleTargets(int source, const vector<char> &isTarget, size_t targetCount, Workspace &ws) const
+    {
+        ws.reset(names.size());
+        ws.set(source, 0, -1);
+        ws.heap.push_back({0, source});
+
+        while (!ws.heap.empty() && targetCount > 0)
+        {
+            pop_heap(ws.heap.begin(), ws.heap.end(), greater<>());
+            pair<int, int> top = ws.heap.back();
+            ws.heap.pop_back();
+            int currentDist = top.first;
+            int currentNode = top.second;
+            if (currentDist > ws.dist(currentNode))
+                continue;
+            if (isTarget[currentNode])
+                targetCount--;
+
+            for (int e = offsets[currentNode]; e < offsets[currentNode + 1]; e++)
+            {
+                int next = targets[e];
+                int newDist = currentDist + weights[e];
+                if (newDist < ws.dist(next))
+                {
+                    ws.set(next, newDist, currentNode);
+                    ws.heap.push_back({newDist, next});
+                    push_heap(ws.heap.begin(), ws.heap.end(), greater<>());
+                }
+            }
+        }
+    }
+
+    // Exhaustive search of the upward graph; settled lists every node reached.
+    void upwardSearch(int source, Workspace &ws, vector<int> &settled) const
+    {
+        ws.reset(names.size());
+        ws.set(source, 0, -1);
+        ws.heap.push_back({0, source});
+        settled.clear();
+
+        while (!ws.heap.empty())
+        {
+            pop_heap(ws.heap.begin(), ws.heap.end(), greater<>());
+            pair<int, int> top = ws.heap.back();
+            ws.heap.pop_back();
+            if (top.first > ws.dist(top.second))
+                continue;
+            settled.push_back(top.second);
+            for (int e = upOffsets[top.second]; e < upOffsets[top.second + 1]; e++)
+            {
+                const UpEdge &edge = upEdges[e];
+                int newDist = top.first + edge.weight;
+                if (newDist < ws.dist(edge.to))
+                {
+                    ws.set(edge.to, newDist, top.second);
+                    ws.heap.push_back({newDist, edge.to});
+                    push_heap(ws.heap.begin(), ws.heap.end(), greater<>());
+                }
+            }
+        }
+    }
+
+    void fillRowsByDijkstra(const vector<int> &sourceIds, const vector<int> &targetIds, DistanceMatrix &table, unsigned threads) const
+    {
+        vector<char> isTarget(names.size(), 0);
+        size_t distinctTargets = 0;
+        for (int id : targetIds)
+        {
+            if (id >= 0 && !isTarget[id])
+            {
+                isTarget[id] = 1;
+                distinctTargets++;
+            }
+        }
+
+        parallelFor(sourceIds.size(), threads, [&](size_t row)
+        {
+            if (sourceIds[row] < 0)
+                return;
+            Workspace &ws = workspace();
+            settleTargets(sourceIds[row], isTarget, distinctTargets, ws);
+            for (size_t col = 0; col < targetIds.size(); col++)
+            {
+                if (targetIds[col] < 0)
+                    continue;
+                int distance = ws.dist(targetIds[col]);
+                table.values[row * table.cols + col] = distance == INT_MAX ? -1 : distance;
+            }
+        });
+    }
+
+    // Many-to-many on the hierarchy: one backward upward search per target
+    // fills per-node buckets, then each source's forward upward search only
+    // has to scan the buckets of the nodes it settles.
+    void fillRowsByHierarchy(const vector<int> &sourceIds, const vector<int> &targetIds, DistanceMatrix &table, unsigned threads) const
+    {
+        vector<vector<pair<int, int>>> buckets(names.size());
+        Workspace &ws = workspace();
+        vector<int> settled;
+        for (size_t col = 0; col < targetIds.size(); col++)
+        {
+            if (targetIds[col] < 0)
+                continue;
+            upwardSearch(targetIds[col], ws, settled);
+            for (int node : settled)
+                buckets[node].push_back({(int)col, ws.dist(node)});
+        }
+
+        parallelFor(sourceIds.size(), threads, [&](size_t row)
+        {
+            if (sourceIds[row] < 0)
+                return;
+            Workspace &forward = workspace();
+            vector<int> reached;
+            upwardSearch(sourceIds[row], forward, reached);
+            int *out = &table.values[row * table.cols];
+            for (int node : reached)
+            {
+                int base = forward.dist(node);
+                for (const pair<int, int> &entry : buckets[node])
+                {
+                    int distance = base + entry.second;
+                    if (out[entry.first] < 0 || distance < out[entry.first])
+                        out[entry.first] = distance;
+                }
+            }
+        });
+    }
+
+    // Edges parsed from one newline-aligned slice of a bulk import file.
+    // Edge-list names stay as views into the mapped file and are numbered
+    // locally so only distinct names need the shared intern table.
+    struct ParsedChunk
+    {
+        vector<int> endpoints;
+        vector<int> weights;
+        vector<string_view> localNames;
+        vector<size_t> nameHashes;
+        vector<int> slots;
+        vector<int> globalIds;
+
+        // Open-addressing lookup; a node-based map spends most of a large
+        // import chasing bucket chains.
+        int localId(string_view name)
+        {
+            if (localNames.size() * 2 >= slots.size())
+            {
+                slots.assign(max<size_t>(1024, slots.size() * 2), -1);
+                for (size_t id = 0; id < localNames.size(); id++)
+                {
+                    size_t slot = nameHashes[id] & (slots.size() - 1);
+                    while (slots[slot] >= 0)
+                        slot = (slot + 1) & (slots.size() - 1);
+                    slots[slot] = (int)id;
+                }
+            }
+
+            size_t h = hash<string_view>()(name);
+            size_t slot = h & (slots.size() - 1);
+            while (slots[slot] >= 0)
+            {
+                int id = slots[slot];
+                if (nameHashes[id] == h && localNames[id] == name)
+                    return id;
+                slot = (slot + 1) & (slots.size() - 1);
+            }
+            slots[slot] = (int)localNames.size();
+            localNames.push_back(name);
+            nameHashes.push_back(h);
+            return slots[slot];
+        }
+    };
+
+    static bool nextToken(const char *&p, const char *end, string_view &token)
+    {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ',' || *p == '\r'))
+            p++;
+        const char *start = p;
+        while (p < end && *p != ' ' && *p != '\t' && *p != ',' && *p != '\r')
+            p++;
+        token = string_view(start, p - start);
+        return p > start;
+    }
+
+    static bool parseInt(string_view token, int &value)
+    {
+        return from_chars(token.data(), token.data() + token.size(), value).ec == errc();
+    }
+
+    static void parseChunk(const char *p, const char *end, bool dimacs, ParsedChunk &chunk)
+    {
+        while (p < end)
+        {
+            const char *lineEnd = (const char *)memchr(p, '\n', end - p);
+            if (!lineEnd)
+                lineEnd = end;
+            const char *cursor = p;
+            p = lineEnd + 1;
+
+            string_view tokens[4];
+            int count = 0;
+            while (count < 4 && nextToken(cursor, lineEnd, tokens[count]))
+                count++;
+
+            if (dimacs)
+            {
+                int from, to, weight;
+                if (count == 4 && tokens[0] == "a" && parseInt(tokens[1], from) && parseInt(tokens[2], to) && parseInt(tokens[3], weight) &&
+                    from > 0 && to > 0)
+                {
+                    chunk.endpoints.push_back(from);
+                    chunk.endpoints.push_back(to);
+                    chunk.weights.push_back(weight);
+                }
+                continue;
+            }
+
+            int weight;
+            if (count < 3 || tokens[0][0] == '#' || !parseInt(tokens[2], weight))
+                continue;
+            chunk.endpoints.push_back(chunk.localId(tokens[0]));
+            chunk.endpoints.push_back(chunk.localId(tokens[1]));
+            chunk.weights.push_back(weight);
+        }
+    }
+
+public:
+    // Bulk import of a road network: either an edge list ("from to distance"
+    // per line, '#' comments) or a DIMACS shortest-path file ("p sp n m" and
+    // "a u v w" lines). The file is memory-mapped and parsed in parallel
+    // newline-aligned chunks; the CSR adjacency is then built once. Every
+    // record is added as a two-way road, like addEdge, and logged with one
+    // commit for the whole file. Returns the number of roads loaded, -1 if
+    // the file cannot be opened or -2 if the roads were loaded but could not
+    // be logged.
+    long long loadEdgeFile(const string &path, unsigned threads = 0)
+    {
+        MappedFile file;
+        if (!file.open(path))
+            return -1;
+        const char *begin = file.data();
+        const char *end = begin + file.size();
+
+        bool dimacs = false;
+        int dimacsNodes = 0;
+        for (const char *p = begin; p < end;)
+        {
+            const char *lineEnd = (const char *)memchr(p, '\n', end - p);
+            if (!lineEnd)
+                lineEnd = end;
+            string_view tokens[3];
+            const char *cursor = p;
+            int count = 0;
+            while (count < 3 && nextToken(cursor, lineEnd, tokens[count]))
+                count++;
+            p = lineEnd + 1;
+            if (count == 0)
+                continue;
+            if (tokens[0] != "c" && tokens[0] != "p")
+                break;
+            dimacs = true;
+            if (tokens[0] == "p")
+            {
+                if (count == 3)
+                    parseInt(tokens[2], dimacsNodes);
+                break;
+            }
+        }
+
+        if (threads == 0)
+            threads = max(1u, thread::hardware_concurrency());
+        size_t chunkCount = max<size_t>(1, min<size_t>(threads * 4, file.size() / (1 << 16) + 1));
+        vector<const char *> bounds(chunkCount + 1, end);
+        bounds[0] = begin;
+        for (size_t i = 1; i < chunkCount; i++)
+        {
+            const char *guess = begin + file.size() / chunkCount * i;
+            guess = max(guess, bounds[i - 1]);
+            const char *newline = (const char *)memchr(guess, '\n', end - guess);
+            bounds[i] = newline ? newline + 1 : end;
+        }
+
+        vector<ParsedChunk> chunks(chunkCount);
+        parallelFor(chunkCount, threads, [&](size_t i)
+        {
+            parseChunk(bounds[i], bounds[i + 1], dimacs, chunks[i]);
+        });
+
+        vector<size_t> firstEdge(chunkCount + 1, edges.size());
+        for (size_t i = 0; i < chunkCount; i++)
+            firstEdge[i + 1] = firstEdge[i] + chunks[i].weights.size();
+
+        vector<int> dimacsIds;
+        if (dimacs)
+        {
+            for (const ParsedChunk &chunk : chunks)
+            {
+                for (int node : chunk.endpoints)
+                    dimacsNodes = max(dimacsNodes, node);
+            }
+            dimacsIds.resize(dimacsNodes + 1);
+            for (int node = 1; node <= dimacsNodes; node++)
+                dimacsIds[node] = intern(to_string(node));
+        }
+        else
+        {
+            for (ParsedChunk &chunk : chunks)
+            {
+                chunk.globalIds.reserve(chunk.localNames.size());
+                for (string_view name : chunk.localNames)
+                    chunk.globalIds.push_back(intern(string(name)));
+            }
+        }
+
+        edges.resize(firstEdge[chunkCount]);
+        parallelFor(chunkCount, threads, [&](size_t i)
+        {
+            const ParsedChunk &chunk = chunks[i];
+            const vector<int> &ids = dimacs ? dimacsIds : chunk.globalIds;
+            for (size_t e = 0; e < chunk.weights.size(); e++)
+                edges[firstEdge[i] + e] = {ids[chunk.endpoints[2 * e]], ids[chunk.endpoints[2 * e + 1]], chunk.weights[e]};
+        });
+
+        if (log)
+        {
+            for (size_t e = firstEdge[0]; e < edges.size(); e++)
+                log->append(LogRecordType::AddEdge, names[edges[e].from], names[edges[e].to], (int32_t)edges[e].weight);
+            size_t kept = firstEdge[0];
+            WriteAheadLog::undoIfLost([this, kept]()
+            {
+                edges.resize(kept);
+                frozen = false;
+                hierarchyBuilt = false;
+            });
+        }
+        frozen = false;
+        hierarchyBuilt = false;
+        freeze();
+        if (log && !log->commit())
+            return -2;
+        return (long long)(firstEdge[chunkCount] - firstEdge[0]);
+    }
+
+    // Names, edges, adjacency arrays and, if built, the contraction
+    // hierarchy, so a restored graph answers queries without preprocessing.
+    void writeSnapshot(SnapshotWriter &out)
+    {
+        freeze();
+        out.put<uint64_t>(names.size());
+        for (const string &name : names)
+            out.putString(name);
+        out.putVector(edges);
+        out.putVector(offsets);
+        out.putVector(targets);
+        out.putVector(weights);
+        out.put<uint8_t>(useHierarchy);
+        out.put<uint8_t>(hierarchyBuilt);
+        if (hierarchyBuilt)
+        {
+            out.putVector(rankOf);
+            out.putVector(upOffsets);
+            out.putVector(upEdges);
+        }
+    }
+
+    bool readSnapshot(SnapshotCursor &in)
+    {
+        uint64_t nameCount = in.get<uint64_t>();
+        names.clear();
+        idByName.clear();
+        names.reserve(nameCount);
+        idByName.reserve(nameCount);
+        for (uint64_t i = 0; i < nameCount && in.ok(); i++)
+            intern(string(in.getString()));
+        if (!in.getVector(edges) || !in.getVector(offsets) || !in.getVector(targets) || !in.getVector(weights))
+            return false;
+        frozen = true;
+        chooseDelta();
+        useHierarchy = in.get<uint8_t>() != 0;
+        hierarchyBuilt = in.get<uint8_t>() != 0;
+        if (hierarchyBuilt && (!in.getVector(rankOf) || !in.getVector(upOffsets) || !in.getVector(upEdges)))
+            return false;
+        return in.ok() && names.size() == nameCount && (names.empty() || offsets.size() == names.size() + 1);
+    }
+
+    // False if the road could not be logged, in which case it is taken
+    // back again.
+    bool addEdge(const string &from, const string &to, int weight)
+    {
+        int fromId = intern(from);
+        int toId = intern(to);
+        edges.push_back({fromId, toId, weight});
+        frozen = false;
+        hierarchyBuilt = false;
+        if (!log)
+            return true;
+        log->append(LogRecordType::AddEdge, from, to, (int32_t)weight);
+        WriteAheadLog::undoIfLost([this, fromId, toId, weight]()
+                                  { removeEdge(fromId, toId, weight); });
+        return log->commit();
+    }
+
+    // Drops the latest edge from -> to of that weight; its endpoints stay.
+    void removeEdge(int from, int to, int weight)
+    {
+        for (size_t e = edges.size(); e-- > 0;)
+        {
+            if (edges[e].from == from && edges[e].to == to && edges[e].weight == weight)
+            {
+                edges.erase(edges.begin() + e);
+                frozen = false;
+                hierarchyBuilt = false;
+                return;
+            }
+        }
+    }
+
+    // Road edits are logged from now on.
+    void attachLog(WriteAheadLog *journal)
+    {
+        log = journal;
+    }
+
+    // Selects the single-source engine used by shortestPath and
+    // findShortestPath when the contraction hierarchy is off. Delta-stepping
+    // relaxes each distance bucket on up to `threads` threads (0 = one per
+    // core); a bucket width of 0 picks max road length / average degree.
+    void setShortestPathEngine(ShortestPathEngine selected, unsigned threads = 0, int width = 0)
+    {
+        engine = selected;
+        engineThreads = threads;
+        bucketWidth = width;
+        if (frozen)
+            chooseDelta();
+    }
+
+    ShortestPathEngine shortestPathEngine() const
+    {
+        return engine;
+    }
+
+    // Optional preprocessing: once enabled, distance and path queries are
+    // answered from a contraction hierarchy that is rebuilt lazily after the
+    // graph changes.
+    void enableContractionHierarchy(bool enabled)
+    {
+        useHierarchy = enabled;
+    }
+
+    bool contractionHierarchyEnabled() const
+    {
+        return useHierarchy;
+    }
+
+    // Builds the adjacency arrays (and the hierarchy, when enabled) up front
+    // so that concurrent queries only read the graph.
+    void prepareQueries()
+    {
+        freeze();
+        if (useHierarchy)
+            ensureHierarchy();
+    }
+
+    int nodeId(const string &name) const
+    {
+        auto it = idByName.find(name);
+        return it == idByName.end() ? -1 : it->second;
+    }
+
+    size_t nodeCount() const
+    {
+        return names.size();
+    }
+
+    size_t edgeCount() const
+    {
+        return edges.size();
+    }
+
+    // One search from source answers the distance to every target.
+    vector<int> distancesFrom(const string &source, const vector<string> &targetNames)
+    {
+        return distanceTable({source}, targetNames, 1).values;
+    }
+
+    // Distance table for every (source, target) pair, rows computed on up to
+    // `threads` threads (0 = one per core). Uses the contraction hierarchy's
+    // bucket method when that mode is enabled.
+    DistanceMatrix distanceTable(const vector<string> &sourceNames, const vector<string> &targetNames, unsigned threads = 0)
+    {
+        DistanceMatrix table;
+        table.rows = sourceNames.size();
+        table.cols = targetNames.size();
+        table.values.assign(table.rows * table.cols, -1);
+
+        vector<int> sourceIds, targetIds;
+        for (const string &name : sourceNames)
+            sourceIds.push_back(nodeId(name));
+        for (const string &name : targetNames)
+            targetIds.push_back(nodeId(name));
+
+        freeze();
+        if (useHierarchy)
+        {
+            ensureHierarchy();
+            fillRowsByHierarchy(sourceIds, targetIds, table, threads);
+        }
+        else
+        {
+            fillRowsByDijkstra(sourceIds, targetIds, table, threads);
+        }
+
+        for (size_t row = 0; row < table.rows; row++)
+        {
+            for (size_t col = 0; col < table.cols; col++)
+            {
+                if (sourceNames[row] == targetNames[col])
+                    table.values[row * table.cols + col] = 0;
+            }
+        }
+        return table;
+    }
+
+    // Calls fn(location, neighbours) for every location, where neighbours is
+    // a list of (location, distance) pairs.
+    template <typename Fn>
+    void forEachLocation(Fn fn)
+    {
+        freeze();
+        vector<pair<string_view, int>> neighbours;
+        for (size_t node = 0; node < names.size(); node++)
+        {
+            neighbours.clear();
+            for (int e = offsets[node]; e < offsets[node + 1]; e++)
+                neighbours.emplace_back(names[targets[e]], weights[e]);
+            fn(string_view(names[node]), neighbours);
+        }
+    }
+
+    void displayLocations()
+    {
+        cout << "Rental Locations and Distances:" << endl;
+        forEachLocation([](string_view location, const vector<pair<string_view, int>> &neighbours)
+        {
+            cout << location << " -> ";
+            for (const auto &neighbour : neighbours)
+                cout << neighbour.first << " (" << neighbour.second << " units), ";
+            cout << "\n";
+        });
+    }
+
+    int shortestPath(const string &start, const string &end)
+    {
+        OperationTimer timer(Metric::ShortestPath);
+        if (start == end)
+            return 0;
+        int source = nodeId(start);
+        int target = nodeId(end);
+        if (source < 0 || target < 0)
+            return -1;
+
+        int distance;
+        if (useHierarchy)
+        {
+            ensureHierarchy();
+            hierarchyQuery(source, target, workspace(0), workspace(1), distance);
+        }
+        else if (engine == ShortestPathEngine::DeltaStepping)
+        {
+            distance = deltaStepping(source, target, nullptr);
+        }
+        else
+        {
+            distance = dijkstra(source, target, workspace());
+        }
+        return distance == INT_MAX ? -1 : distance;
+    }
+
+    // Shortest route as the list of stops from source to destination;
+    // returns its length, or -1 if there is none.
+    int route(const string &source, const string &destination, vector<string> &path)
+    {
+        OperationTimer timer(Metric::ShortestPath);
+        int sourceId = nodeId(source);
+        int targetId = nodeId(destination);
+        path.clear();
+        int distance = INT_MAX;
+
+        if (source == destination)
+        {
+            path.push_back(source);
+            distance = 0;
+        }
+        else if (sourceId >= 0 && targetId >= 0 && useHierarchy)
+        {
+            ensureHierarchy();
+            int meeting = hierarchyQuery(sourceId, targetId, workspace(0), workspace(1), distance);
+            if (distance != INT_MAX)
+            {
+                for (int node : hierarchyPath(sourceId, targetId, meeting, workspace(0), workspace(1)))
+                    path.push_back(names[node]);
+            }
+        }
+        else if (sourceId >= 0 && targetId >= 0 && engine == ShortestPathEngine::DeltaStepping)
+        {
+            vector<int> nodes;
+            distance = deltaStepping(sourceId, targetId, &nodes);
+            for (int node : nodes)
+                path.push_back(names[node]);
+        }
+        else if (sourceId >= 0 && targetId >= 0)
+        {
+            Workspace &ws = workspace();
+            distance = dijkstra(sourceId, targetId, ws);
+            if (distance != INT_MAX)
+            {
+                for (int at = targetId; at != -1; at = ws.previous[at])
+                    path.push_back(names[at]);
+                reverse(path.begin(), path.end());
+            }
+        }
+
+        if (distance == INT_MAX)
+        {
+            path.clear();
+            return -1;
+        }
+        return distance;
+    }
+
+    void findShortestPath(const string &source, const string &destination)
+    {
+        vector<string> path;
+        int distance = route(source, destination, path);
+        if (distance < 0)
+        {
+            cout << "No path found from " << source << " to " << destination << "!\n";
+        }
+        else
+        {
+            cout << "Shortest path from " << source << " to " << destination << ":\n";
+            for (size_t i = 0; i < path.size(); i++)
+            {
+                cout << path[i];
+                if (i + 1 < path.size())
+                    cout << " -> ";
+            }
+            cout << "\nTotal Distance: " << distance << " km\n";
+        }
+    }
+};
+
+// Append-only booking log. Records are packed into fixed-size arena chunks
+// (one allocation per chunk, not per booking) and indexed by a vector of
+// views, so appends are O(1) and iteration is sequential. Every record is
+// also appended to a journal file; displayHistory maps that file, so the
+// history survives restarts without being reloaded into memory.
+class BookingHistory
+{
+    static constexpr size_t chunkSize = 64 * 1024;
+
+    vector<unique_ptr<char[]>> chunks;
+    size_t chunkUsed;
+    vector<string_view> records;
+    string journalPath;
+    ofstream journal;
+
+    string_view store(const string &details)
+    {
+        size_t length = details.size();
+        if (chunks.empty() || chunkUsed + length > chunkSize)
+        {
+            chunks.emplace_back(new char[max(chunkSize, length)]);
+            chunkUsed = 0;
+        }
+        char *destination = chunks.back().get() + chunkUsed;
+        memcpy(destination, details.data(), length);
+        chunkUsed += length;
+        return string_view(destination, length);
+    }
+
+public:
+    BookingHistory(const string &path = "bookings.log") : chunkUsed(0), journalPath(path)
+    {
+        if (!journalPath.empty())
+            journal.open(journalPath, ios::app | ios::binary);
+    }
+
+    void addBooking(const string &details)
+    {
+        string line = details;
+        replace(line.begin(), line.end(), '\n', ' ');
+        records.push_back(store(line));
+        if (journal)
+        {
+            journal << line << '\n';
+            journal.flush();
+        }
+    }
+
+    // Bookings added since this process started.
+    const vector<string_view> &sessionRecords() const
+    {
+        return records;
+    }
+
+    // Calls fn(record) for every booking in the journal, or for this
+    // session's bookings when there is no journal. Returns the count.
+    template <typename Fn>
+    size_t forEachRecord(Fn fn) const
+    {
+        size_t count = 0;
+        MappedFile file;
+        if (journal && file.open(journalPath))
+        {
+            string_view data = file.view();
+            while (!data.empty())
+            {
+                size_t newline = data.find('\n');
+                fn(data.substr(0, newline));
+                count++;
+                data = newline == string_view::npos ? string_view() : data.substr(newline + 1);
+            }
+            return count;
+        }
+        for (string_view record : records)
+        {
+            fn(record);
+            count++;
+        }
+        return count;
+    }
+
+    void displayHistory() const
+    {
+        bool headerShown = false;
+        size_t count = forEachRecord([&headerShown](string_view record)
+        {
+            if (!headerShown)
+                cout << "Booking History:" << endl;
+            headerShown = true;
+            cout << record << "\n";
+        });
+        if (count == 0)
+            cout << "No booking history available." << endl;
+    }
+};
+
+// B+-tree keyed on vehicle id. Nodes are cache-line aligned with their keys
+// stored contiguously; details strings live in a side vector so leaves stay
+// small. Leaves are linked for in-order and range scans, and every
+// operation is iterative, so sequential ids cannot degrade it into a list
+// or overflow the stack.
+class VehicleTree
+{
+    static constexpr int order = 32;
+
+    struct alignas(64) Node
+    {
+        bool leaf;
+        int count;
+        int keys[order];
+
+        explicit Node(bool isLeaf) : leaf(isLeaf), count(0) {}
+    };
+
+    struct alignas(64) Leaf : Node
+    {
+        uint32_t values[order];
+        Leaf *next;
+
+        Leaf() : Node(true), next(nullptr) {}
+    };
+
+    struct alignas(64) Inner : Node
+    {
+        Node *children[order + 1];
+
+        Inner() : Node(false) {}
+    };
+
+    Node *root;
+    vector<string> details;
+    size_t vehicleCount;
+
+    static int childIndex(const Inner *node, int id)
+    {
+        return (int)(upper_bound(node->keys, node->keys + node->count, id) - node->keys);
+    }
+
+    const Leaf *findLeaf(int id) const
+    {
+        const Node *node = root;
+        while (node && !node->leaf)
+        {
+            const Inner *inner = static_cast<const Inner *>(node);
+            node = inner->children[childIndex(inner, id)];
+        }
+        return static_cast<const Leaf *>(node);
+    }
+
+    const Leaf *leftmostLeaf() const
+    {
+        const Node *node = root;
+        while (node && !node->leaf)
+            node = static_cast<const Inner *>(node)->children[0];
+        return static_cast<const Leaf *>(node);
+    }
+
+    // Inserts (separator, right) into the parents on path, splitting upwards.
+    void insertIntoParents(vector<pair<Inner *, int>> &path, int separator, Node *right)
+    {
+        while (!path.empty())
+        {
+            Inner *parent = path.back().first;
+            int position = path.back().second;
+            path.pop_back();
+
+            if (parent->count < order)
+            {
+                copy_backward(parent->keys + position, parent->keys + parent->count, parent->keys + parent->count + 1);
+                copy_backward(parent->children + position + 1, parent->children + parent->count + 1,
+                              parent->children + parent->count + 2);
+                parent->keys[position] = separator;
+                parent->children[position + 1] = right;
+                parent->count++;
+                return;
+            }
+
+            int keys[order + 1];
+            Node *children[order + 2];
+            copy(parent->keys, parent->keys + position, keys);
+            keys[position] = separator;
+            copy(parent->keys + position, parent->keys + order, keys + position + 1);
+            copy(parent->children, parent->children + position + 1, children);
+            children[position + 1] = right;
+            copy(parent->children + position + 1, parent->children + order + 1, children + position + 2);
+
+            int middle = (order + 1) / 2;
+            Inner *sibling = new Inner();
+            parent->count = middle;
+            copy(keys, keys + middle, parent->keys);
+            copy(children, children + middle + 1, parent->children);
+            sibling->count = order - middle;
+            copy(keys + middle + 1, keys + order + 1, sibling->keys);
+            copy(children + middle + 1, children + order + 2, sibling->children);
+
+            separator = keys[middle];
+            right = sibling;
+        }
+
+        Inner *newRoot = new Inner();
+        newRoot->count = 1;
+        newRoot->keys[0] = separator;
+        newRoot->children[0] = root;
+        newRoot->children[1] = right;
+        root = newRoot;
+    }
+
+    void clear()
+    {
+        vector<Node *> pending;
+        if (root)
+            pending.push_back(root);
+        while (!pending.empty())
+        {
+            Node *node = pending.back();
+            pending.pop_back();
+            if (node->leaf)
+            {
+                delete static_cast<Leaf *>(node);
+                continue;
+            }
+            Inner *inner = static_cast<Inner *>(node);
+            pending.insert(pending.end(), inner->children, inner->children + inner->count + 1);
+            delete inner;
+        }
+        root = nullptr;
+        details.clear();
+        vehicleCount = 0;
+    }
+
+public:
+    VehicleTree() : root(nullptr), vehicleCount(0) {}
+    VehicleTree(const VehicleTree &) = delete;
+    VehicleTree &operator=(const VehicleTree &) = delete;
+
+    ~VehicleTree()
+    {
+        clear();
+    }
+
+    // Ids already in the tree are ignored, as before.
+    void addVehicle(int id, const string &vehicleDetails)
+    {
+        if (!root)
+            root = new Leaf();
+
+        vector<pair<Inner *, int>> path;
+        Node *node = root;
+        while (!node->leaf)
+        {
+            Inner *inner = static_cast<Inner *>(node);
+            int position = childIndex(inner, id);
+            path.push_back({inner, position});
+            node = inner->children[position];
+        }
+
+        Leaf *leaf = static_cast<Leaf *>(node);
+        int position = (int)(lower_bound(leaf->keys, leaf->keys + leaf->count, id) - leaf->keys);
+        if (position < leaf->count && leaf->keys[position] == id)
+            return;
+
+        uint32_t value = (uint32_t)details.size();
+        details.push_back(vehicleDetails);
+        vehicleCount++;
+
+        if (leaf->count < order)
+        {
+            copy_backward(leaf->keys + position, leaf->keys + leaf->count, leaf->keys + leaf->count + 1);
+            copy_backward(leaf->values + position, leaf->values + leaf->count, leaf->values + leaf->count + 1);
+            leaf->keys[position] = id;
+            leaf->values[position] = value;
+            leaf->count++;
+            return;
+        }
+
+        int keys[order + 1];
+        uint32_t values[order + 1];
+        copy(leaf->keys, leaf->keys + position, keys);
+        copy(leaf->values, leaf->values + position, values);
+        keys[position] = id;
+        values[position] = value;
+        copy(leaf->keys + position, leaf->keys + order, keys + position + 1);
+        copy(leaf->values + position, leaf->values + order, values + position + 1);
+
+        int middle = (order + 1) / 2;
+        Leaf *sibling = new Leaf();
+        leaf->count = middle;
+        copy(keys, keys + middle, leaf->keys);
+        copy(values, values + middle, leaf->values);
+        sibling->count = order + 1 - middle;
+        copy(keys + middle, keys + order + 1, sibling->keys);
+        copy(values + middle, values + order + 1, sibling->values);
+        sibling->next = leaf->next;
+        leaf->next = sibling;
+
+        insertIntoParents(path, sibling->keys[0], sibling);
+    }
+
+    // Replaces the contents with vehicles sorted by id, packing leaves and
+    // building each inner level bottom-up. Unsorted input is sorted first;
+    // for repeated ids the first entry wins.
+    void bulkLoad(vector<pair<int, string>> vehicles)
+    {
+        clear();
+        auto lessById = [](const pair<int, string> &a, const pair<int, string> &b)
+        {
+            return a.first < b.first;
+        };
+        auto sameId = [](const pair<int, string> &a, const pair<int, string> &b)
+        {
+            return a.first == b.first;
+        };
+        if (!is_sorted(vehicles.begin(), vehicles.end(), lessById))
+            stable_sort(vehicles.begin(), vehicles.end(), lessById);
+        vehicles.erase(unique(vehicles.begin(), vehicles.end(), sameId), vehicles.end());
+        if (vehicles.empty())
+            return;
+
+        details.reserve(vehicles.size());
+        vector<Node *> level;
+        vector<int> lowKeys;
+        size_t leafCount = (vehicles.size() + order - 1) / order;
+        Leaf *previous = nullptr;
+        for (size_t i = 0, begin = 0; i < leafCount; i++)
+        {
+            size_t end = vehicles.size() * (i + 1) / leafCount;
+            Leaf *leaf = new Leaf();
+            for (size_t v = begin; v < end; v++)
+            {
+                leaf->keys[leaf->count] = vehicles[v].first;
+                leaf->values[leaf->count++] = (uint32_t)details.size();
+                details.push_back(move(vehicles[v].second));
+            }
+            if (previous)
+                previous->next = leaf;
+            previous = leaf;
+            level.push_back(leaf);
+            lowKeys.push_back(leaf->keys[0]);
+            begin = end;
+        }
+        vehicleCount = vehicles.size();
+
+        while (level.size() > 1)
+        {
+            vector<Node *> parents;
+            vector<int> parentLowKeys;
+            size_t parentCount = (level.size() + order) / (order + 1);
+            for (size_t i = 0, begin = 0; i < parentCount; i++)
+            {
+                size_t end = level.size() * (i + 1) / parentCount;
+                Inner *inner = new Inner();
+                inner->children[0] = level[begin];
+                for (size_t c = begin + 1; c < end; c++)
+                {
+                    inner->keys[inner->count] = lowKeys[c];
+                    inner->children[++inner->count] = level[c];
+                }
+                parents.push_back(inner);
+                parentLowKeys.push_back(lowKeys[begin]);
+                begin = end;
+            }
+            level.swap(parents);
+            lowKeys.swap(parentLowKeys);
+        }
+        root = level[0];
+    }
+
+    size_t size() const
+    {
+        return vehicleCount;
+    }
+
+    // Vehicles in id order, so reading is a linear bulk load.
+    void writeSnapshot(SnapshotWriter &out) const
+    {
+        vector<int> ids;
+        ids.reserve(vehicleCount);
+        forEachInRange(INT_MIN, INT_MAX, [&](int id, const string &)
+                       { ids.push_back(id); });
+        out.putVector(ids);
+        forEachInRange(INT_MIN, INT_MAX, [&](int, const string &vehicleDetails)
+                       { out.putString(vehicleDetails); });
+    }
+
+    bool readSnapshot(SnapshotCursor &in)
+    {
+        vector<int> ids;
+        if (!in.getVector(ids))
+            return false;
+        vector<pair<int, string>> vehicles(ids.size());
+        for (size_t i = 0; i < ids.size(); i++)
+            vehicles[i] = {ids[i], string(in.getString())};
+        if (!in.ok())
+            return false;
+        bulkLoad(move(vehicles));
+        return true;
+    }
+
+    const string *findVehicle(int id) const
+    {
+        const Leaf *leaf = findLeaf(id);
+        if (!leaf)
+            return nullptr;
+        const int *position = lower_bound(leaf->keys, leaf->keys + leaf->count, id);
+        if (position == leaf->keys + leaf->count || *position != id)
+            return nullptr;
+        return &details[leaf->values[position - leaf->keys]];
+    }
+
+    // Calls fn(id, details) for every vehicle with low <= id <= high, in order.
+    template <typename Fn>
+    void forEachInRange(int low, int high, Fn fn) const
+    {
+        const Leaf *leaf = findLeaf(low);
+        int position = leaf ? (int)(lower_bound(leaf->keys, leaf->keys + leaf->count, low) - leaf->keys) : 0;
+        for (; leaf; leaf = leaf->next, position = 0)
+        {
+            for (; position < leaf->count; position++)
+            {
+                if (leaf->keys[position] > high)
+                    return;
+                fn(leaf->keys[position], details[leaf->values[position]]);
+            }
+        }
+    }
+
+    void displayInventory() const
+    {
+        if (!root || vehicleCount == 0)
+        {
+            cout << "No vehicles in the inventory." << endl;
+            return;
+        }
+        for (const Leaf *leaf = leftmostLeaf(); leaf; leaf = leaf->next)
+        {
+            for (int i = 0; i < leaf->count; i++)
+                cout << "ID: " << leaf->keys[i] << ", Details: " << details[leaf->values[i]] << endl;
+        }
+    }
+
+    void displayRange(int low, int high) const
+    {
+        bool found = false;
+        forEachInRange(low, high, [&](int id, const string &vehicleDetails)
+        {
+            cout << "ID: " << id << ", Details: " << vehicleDetails << endl;
+            found = true;
+        });
+        if (!found)
+            cout << "No vehicles with IDs between " << low << " and " << high << "." << endl;
+    }
+};
+
+enum class CarCategory : uint8_t
+{
+    SUV,
+    Sedan,
+    Hatchback,
+    Count
+};
+
+enum class RateType : uint8_t
+{
+    Day,
+    Hour,
+    Count
+};
+
+const int categoryCount = (int)CarCategory::Count;
+const int rateTypeCount = (int)RateType::Count;
+
+// Amounts are int64 paise (1/100 INR) so long rentals cannot overflow.
+typedef int64_t Money;
+
+constexpr Money rateTable[categoryCount][rateTypeCount] = {
+    {1000000, 50000}, // SUV: 10,000 INR a day, 500 INR an hour
+    {500000, 30000},  // Sedan
+    {400000, 25000},  // Hatchback
+};
+
+inline const char *categoryName(CarCategory category)
+{
+    static const char *const names[categoryCount] = {"SUV", "Sedan", "Hatchback"};
+    return names[(int)category];
+}
+
+inline bool parseCategory(string_view name, CarCategory &category)
+{
+    for (int c = 0; c < categoryCount; c++)
+    {
+        if (name == categoryName((CarCategory)c))
+        {
+            category = (CarCategory)c;
+            return true;
+        }
+    }
+    return false;
+}
+
+inline bool parseRateType(string_view name, RateType &type)
+{
+    if (name == "day")
+        type = RateType::Day;
+    else if (name == "hour")
+        type = RateType::Hour;
+    else
+        return false;
+    return true;
+}
+
+inline string formatMoney(Money amount)
+{
+    string text = to_string(amount / 100);
+    if (amount % 100 != 0)
+    {
+        Money paise = amount < 0 ? -(amount % 100) : amount % 100;
+        text += (paise < 10 ? ".0" : ".") + to_string(paise);
+    }
+    return text + " INR";
+}
+
+class Car
+{
+public:
+    int id;
+    string category;
+    string name;
+    int branch;
+
+    Car(int id, string category, string name, int branch = 0)
+    {
+        this->id = id;
+        this->category = category;
+        this->name = name;
+        this->branch = branch;
+    }
+};
+
+class FleetStore;
+
+// A car in the fleet, read from its columns only when asked, so listing
+// many cars copies a slot per car rather than every field. The name points
+// into the fleet's interned names and stays valid as long as the fleet.
+class CarView
+{
+    const FleetStore *fleet;
+    size_t slot;
+
+public:
+    CarView(const FleetStore &fleet, size_t slot) : fleet(&fleet), slot(slot) {}
+
+    int id() const;
+    CarCategory category() const;
+    int branch() const;
+    string_view name() const;
+};
+
+inline int lowestSetBit(uint64_t word)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return (int)index;
+#else
+    return __builtin_ctzll(word);
+#endif
+}
+
+inline int popCount(uint64_t word)
+{
+#ifdef _MSC_VER
+    return (int)__popcnt64(word);
+#else
+    return __builtin_popcountll(word);
+#endif
+}
+
+// Bit i is set where values[i] == value, over 64 consecutive values.
+inline uint64_t equalMask64(const uint8_t *values, uint8_t value)
+{
+#ifdef __SSE2__
+    __m128i target = _mm_set1_epi8((char)value);
+    uint64_t mask = 0;
+    for (int i = 0; i < 64; i += 16)
+    {
+        __m128i equal = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(values + i)), target);
+        mask |= (uint64_t)(uint32_t)_mm_movemask_epi8(equal) << i;
+    }
+    return mask;
+#else
+    uint64_t mask = 0;
+    for (int i = 0; i < 64; i++)
+        mask |= (uint64_t)(values[i] == value) << i;
+    return mask;
+#endif
+}
+
+inline uint64_t equalMask64(const uint16_t *values, uint16_t value)
+{
+#ifdef __SSE2__
+    __m128i target = _mm_set1_epi16((short)value);
+    uint64_t mask = 0;
+    for (int i = 0; i < 64; i += 16)
+    {
+        __m128i low = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *)(values + i)), target);
+        __m128i high = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *)(values + i + 8)), target);
+        mask |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_packs_epi16(low, high)) << i;
+    }
+    return mask;
+#else
+    uint64_t mask = 0;
+    for (int i = 0; i < 64; i++)
+        mask |= (uint64_t)(values[i] == value) << i;
+    return mask;
+#endif
+}
+
+// Growable bitset of atomic words. Growing must not race with other calls;
+// testing, setting and clearing bits are lock-free.
+class AtomicBitset
+{
+    unique_ptr<atomic<uint64_t>[]> words;
+    size_t wordCount = 0;
+    size_t capacity = 0;
+
+public:
+    void grow(size_t bits)
+    {
+        size_t needed = (bits + 63) / 64;
+        if (needed <= wordCount)
+            return;
+        if (needed > capacity)
+        {
+            size_t newCapacity = max(needed, capacity * 2);
+            unique_ptr<atomic<uint64_t>[]> bigger(new atomic<uint64_t>[newCapacity]);
+            for (size_t w = 0; w < newCapacity; w++)
+                bigger[w].store(w < wordCount ? words[w].load(memory_order_relaxed) : 0, memory_order_relaxed);
+            words.swap(bigger);
+            capacity = newCapacity;
+        }
+        wordCount = needed;
+    }
+
+    size_t wordsUsed() const
+    {
+        return wordCount;
+    }
+
+    uint64_t word(size_t w) const
+    {
+        return words[w].load(memory_order_acquire);
+    }
+
+    bool test(size_t bit) const
+    {
+        return (word(bit / 64) >> (bit % 64)) & 1;
+    }
+
+    // set and clear return the bit's previous value.
+    bool set(size_t bit)
+    {
+        uint64_t mask = uint64_t(1) << (bit % 64);
+        return words[bit / 64].fetch_or(mask, memory_order_acq_rel) & mask;
+    }
+
+    bool clear(size_t bit)
+    {
+        uint64_t mask = uint64_t(1) << (bit % 64);
+        return words[bit / 64].fetch_and(~mask, memory_order_acq_rel) & mask;
+    }
+};
+
+// Rental times are whole hours since the Unix epoch.
+inline long long currentHour()
+{
+    return (long long)(time(nullptr) / 3600);
+}
+
+inline string formatHour(long long hour)
+{
+    time_t seconds = (time_t)(hour * 3600);
+    char text[32];
+    strftime(text, sizeof(text), "%Y-%m-%d %H:00", localtime(&seconds));
+    return text;
+}
+
+class SpinLock
+{
+    atomic_flag flag = ATOMIC_FLAG_INIT;
+
+public:
+    void lock()
+    {
+        while (flag.test_and_set(memory_order_acquire))
+            this_thread::yield();
+    }
+
+    void unlock()
+    {
+        flag.clear(memory_order_release);
+    }
+};
+
+struct Reservation
+{
+    long long start;
+    long long end;
+    string customer;
+};
+
+// One car's reservations as sorted, non-overlapping [start, end) intervals.
+class ReservationCalendar
+{
+    map<long long, Reservation> byStart;
+
+public:
+    bool isFree(long long start, long long end) const
+    {
+        auto next = byStart.lower_bound(end);
+        if (next == byStart.begin())
+            return true;
+        return prev(next)->second.end <= start;
+    }
+
+    bool reserve(long long start, long long end, const string &customer)
+    {
+        if (start >= end || !isFree(start, end))
+            return false;
+        byStart.emplace(start, Reservation{start, end, customer});
+        return true;
+    }
+
+    // Ends the reservation in progress at `now` early. Returns false if
+    // none was in progress; `before` receives it as it was.
+    bool finishAt(long long now, Reservation &before)
+    {
+        auto it = byStart.upper_bound(now);
+        if (it == byStart.begin())
+            return false;
+        --it;
+        if (it->second.end <= now)
+            return false;
+        before = it->second;
+        if (before.start >= now)
+            byStart.erase(it);
+        else
+            it->second.end = now;
+        return true;
+    }
+
+    // Undo for reserve() and finishAt().
+    void cancel(long long start)
+    {
+        byStart.erase(start);
+    }
+
+    void restore(const Reservation &reservation)
+    {
+        byStart[reservation.start] = reservation;
+    }
+
+    // Hours from `now` until the next reservation starts: 0 if one is in
+    // progress, LLONG_MAX if none follows.
+    long long freeFrom(long long now) const
+    {
+        auto next = byStart.upper_bound(now);
+        if (next != byStart.begin() && prev(next)->second.end > now)
+            return 0;
+        return next == byStart.end() ? LLONG_MAX : next->first - now;
+    }
+
+    template <typename Fn>
+    void forEachFrom(long long from, Fn fn) const
+    {
+        auto it = byStart.upper_bound(from);
+        if (it != byStart.begin() && prev(it)->second.end > from)
+            --it;
+        for (; it != byStart.end(); ++it)
+            fn(it->second);
+    }
+};
+
+// Seasonal surcharge on the days from startMonth/startDay to endMonth/endDay
+// (inclusive) of every year; ranges may wrap past December.
+struct Season
+{
+    int startMonth, startDay, endMonth, endDay;
+    int percent;
+};
+
+// Per-day rates over a fixed horizon of UTC days. A rental is charged, for
+// each calendar day it touches, the hourly rate times the hours used on that
+// day capped at that day's daily rate. Whole-day costs are kept as
+// per-category prefix sums, so any [start, end) in hours is priced with two
+// partial days plus one subtraction.
+class RateCalendar
+{
+    long long firstDay = 0;
+    int dayCount = 0;
+    int weekendPercent = 100;
+    vector<Season> seasons;
+    vector<Money> hourly[categoryCount];
+    vector<Money> daily[categoryCount];
+    vector<Money> prefix[categoryCount];
+
+    static long long floorDiv(long long value, long long by)
+    {
+        return value >= 0 ? value / by : -((-value + by - 1) / by);
+    }
+
+    // Days since 1970-01-01 to month (1-12) and day of month.
+    static void civilDate(long long days, int &month, int &day)
+    {
+        days += 719468;
+        long long era = floorDiv(days, 146097);
+        long long dayOfEra = days - era * 146097;
+        long long yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+        long long dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+        long long monthIndex = (5 * dayOfYear + 2) / 153;
+        day = (int)(dayOfYear - (153 * monthIndex + 2) / 5 + 1);
+        month = (int)(monthIndex < 10 ? monthIndex + 3 : monthIndex - 9);
+    }
+
+    static Money cost(Money hourlyRate, Money dailyRate, long long hours)
+    {
+        return min<Money>(hourlyRate * hours, dailyRate);
+    }
+
+    int dayPercent(long long day) const
+    {
+        long long weekday = ((day + 4) % 7 + 7) % 7; // 1970-01-01 was a Thursday; 0 = Sunday
+        int percent = 100;
+        if (weekday == 0 || weekday == 6)
+            percent = percent * weekendPercent / 100;
+
+        int month, dayOfMonth;
+        civilDate(day, month, dayOfMonth);
+        int date = month * 100 + dayOfMonth;
+        for (const Season &season : seasons)
+        {
+            int from = season.startMonth * 100 + season.startDay;
+            int to = season.endMonth * 100 + season.endDay;
+            bool inside = from <= to ? date >= from && date <= to : date >= from || date <= to;
+            if (inside)
+                percent = percent * season.percent / 100;
+        }
+        return percent;
+    }
+
+public:
+    RateCalendar() {}
+
+    RateCalendar(long long firstDay, int dayCount) : firstDay(firstDay), dayCount(dayCount) {}
+
+    void setWeekendPercent(int percent)
+    {
+        weekendPercent = percent;
+    }
+
+    void addSeason(const Season &season)
+    {
+        seasons.push_back(season);
+    }
+
+    Money rateOn(CarCategory category, RateType type, long long day) const
+    {
+        return rateTable[(int)category][(int)type] * dayPercent(day) / 100;
+    }
+
+    // Must be called after the rules change and before quoting.
+    void build()
+    {
+        for (int c = 0; c < categoryCount; c++)
+        {
+            hourly[c].assign(dayCount, 0);
+            daily[c].assign(dayCount, 0);
+            prefix[c].assign(dayCount + 1, 0);
+        }
+        for (int i = 0; i < dayCount; i++)
+        {
+            int percent = dayPercent(firstDay + i);
+            for (int c = 0; c < categoryCount; c++)
+            {
+                hourly[c][i] = rateTable[c][(int)RateType::Hour] * percent / 100;
+                daily[c][i] = rateTable[c][(int)RateType::Day] * percent / 100;
+                prefix[c][i + 1] = prefix[c][i] + cost(hourly[c][i], daily[c][i], 24);
+            }
+        }
+    }
+
+    bool covers(long long start, long long end) const
+    {
+        return start >= firstDay * 24 && end <= (firstDay + dayCount) * 24;
+    }
+
+    // Price of [start, end) in hours since the epoch; -1 outside the horizon.
+    Money quote(CarCategory category, long long start, long long end) const
+    {
+        if (end <= start)
+            return 0;
+        if (!covers(start, end))
+            return -1;
+
+        int c = (int)category;
+        long long first = start / 24 - firstDay;
+        long long last = end / 24 - firstDay;
+        if (first == last)
+            return cost(hourly[c][first], daily[c][first], end - start);
+
+        Money price = cost(hourly[c][first], daily[c][first], (first + firstDay + 1) * 24 - start);
+        price += prefix[c][last] - prefix[c][first + 1];
+        if (end % 24)
+            price += cost(hourly[c][last], daily[c][last], end % 24);
+        return price;
+    }
+
+    // Day-by-day reference for quote(), evaluating the rules for every day.
+    Money quoteByDay(CarCategory category, long long start, long long end) const
+    {
+        if (end <= start)
+            return 0;
+        if (!covers(start, end))
+            return -1;
+
+        Money price = 0;
+        for (long long hour = start; hour < end;)
+        {
+            long long day = hour / 24;
+            long long next = min(end, (day + 1) * 24);
+            price += min<Money>(rateOn(category, RateType::Hour, day) * (next - hour), rateOn(category, RateType::Day, day));
+            hour = next;
+        }
+        return price;
+    }
+};
+
+// The shop's pricing rules: weekends at 120%, the festival season from
+// October 15 to November 15 at 115% and the year-end holidays at 125%.
+inline RateCalendar standardRateCalendar(long long firstDay, int dayCount)
+{
+    RateCalendar rates(firstDay, dayCount);
+    rates.setWeekendPercent(120);
+    rates.addSeason(Season{10, 15, 11, 15, 115});
+    rates.addSeason(Season{12, 20, 1, 5, 125});
+    rates.build();
+    return rates;
+}
+
+// Cars live in insertion-ordered slots, stored as columns: id, category,
+// branch and an interned name id per slot. An id->slot hash gives O(1)
+// lookup and one availability bitset per category (bit i = slot i) answers
+// "available cars of category X" 64 slots at a time instead of comparing
+// strings per car; a branch filter compares 64 entries of the branch column
+// per word, with SSE2 where available. The bitsets are also the booking
+// state: claiming a car is one atomic fetch_and on its word, so concurrent
+// sessions can never both win the same car. A booking or return then locks
+// only that car and one of its category's schedule shards, so bookings of
+// different cars rarely wait on each other and no global lock is needed.
+// Adding cars is setup-time only and must not run concurrently with bookings.
+class FleetStore
+{
+    // Reservations of the cars in every scheduleShards-th 64-slot word of a
+    // category, ordered by start. Any reservation overlapping [t1, t2)
+    // starts in (t1 - longest, t2), so a free-car query only visits that
+    // window of each shard and then removes the busy slots from the
+    // category's member bitset a word at a time.
+    struct ScheduleShard
+    {
+        mutex lock;
+        multimap<long long, pair<long long, size_t>> reservations;
+        long long longest = 0;
+    };
+
+    static constexpr size_t scheduleShards = 64;
+
+    struct CategorySchedule
+    {
+        ScheduleShard shards[scheduleShards];
+        vector<uint64_t> members;
+    };
+
+    struct CarSchedule
+    {
+        SpinLock lock;
+        ReservationCalendar calendar;
+    };
+
+    // Category and branch are padded to whole 64-slot words with values no
+    // car has, so scans always read full words.
+    vector<int> ids;
+    vector<CarCategory> categoryOfSlot;
+    vector<uint16_t> branchOfSlot;
+    vector<uint32_t> nameOfSlot;
+    deque<string> names;
+    vector<uint32_t> nameHashes;
+    vector<uint32_t> nameTable;
+    unordered_map<int, size_t> slotById;
+    vector<AtomicBitset> availableByCategory;
+    deque<CategorySchedule> categorySchedules;
+    deque<CarSchedule> carSchedules;
+    WriteAheadLog *log = nullptr;
+
+    struct Span
+    {
+        uint64_t slot;
+        int64_t start;
+        int64_t end;
+    };
+
+    static int categoryId(const string &name)
+    {
+        CarCategory category;
+        return parseCategory(name, category) ? (int)category : -1;
+    }
+
+    static constexpr uint16_t noBranch = 0xFFFF;
+
+    ScheduleShard &shardOf(size_t slot)
+    {
+        return categorySchedules[(int)categoryOfSlot[slot]].shards[slot / 64 % scheduleShards];
+    }
+
+    // The slot's reservation starting at start, or end().
+    static multimap<long long, pair<long long, size_t>>::iterator shardEntry(ScheduleShard &shard, long long start, size_t slot)
+    {
+        auto range = shard.reservations.equal_range(start);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (it->second.second == slot)
+                return it;
+        }
+        return shard.reservations.end();
+    }
+
+    static uint32_t nameHash(string_view name)
+    {
+        uint32_t hash = 2166136261u;
+        for (char c : name)
+            hash = (hash ^ (unsigned char)c) * 16777619u;
+        return hash;
+    }
+
+    // Open addressing over name ids + 1 (0 = empty), kept at most half full.
+    void placeName(uint32_t id)
+    {
+        size_t mask = nameTable.size() - 1;
+        size_t at = nameHashes[id] & mask;
+        while (nameTable[at])
+            at = (at + 1) & mask;
+        nameTable[at] = id + 1;
+    }
+
+    uint32_t internName(const string &name)
+    {
+        uint32_t hash = nameHash(name);
+        if (!nameTable.empty())
+        {
+            size_t mask = nameTable.size() - 1;
+            for (size_t at = hash & mask; nameTable[at]; at = (at + 1) & mask)
+            {
+                uint32_t id = nameTable[at] - 1;
+                if (nameHashes[id] == hash && names[id] == name)
+                    return id;
+            }
+        }
+        uint32_t id = (uint32_t)names.size();
+        names.push_back(name);
+        nameHashes.push_back(hash);
+        if (nameTable.size() < 2 * names.size())
+        {
+            nameTable.assign(max<size_t>(64, nameTable.size() * 2), 0);
+            for (uint32_t i = 0; i < id; i++)
+                placeName(i);
+        }
+        placeName(id);
+        return id;
+    }
+
+    // Mask of the slots in word w that belong to branch.
+    uint64_t branchMask(size_t w, int branch) const
+    {
+        return equalMask64(&branchOfSlot[w * 64], (uint16_t)branch);
+    }
+
+public:
+    static const size_t npos = static_cast<size_t>(-1);
+    static constexpr int anyBranch = -1;
+    static constexpr int maxBranches = noBranch;
+
+    FleetStore() : availableByCategory(categoryCount), categorySchedules(categoryCount) {}
+
+    // Reservations and returns are logged from now on, under the car's lock
+    // so each car's records keep their order.
+    void attachLog(WriteAheadLog *journal)
+    {
+        log = journal;
+    }
+
+    // Fails for a duplicate id, an unknown category or a branch outside
+    // [0, maxBranches).
+    bool addCar(const Car &car, bool available = true)
+    {
+        CarCategory category;
+        size_t slot = ids.size();
+        if (!parseCategory(car.category, category) || car.branch < 0 || car.branch >= maxBranches ||
+            !slotById.emplace(car.id, slot).second)
+            return false;
+
+        ids.push_back(car.id);
+        if (slot % 64 == 0)
+        {
+            categoryOfSlot.resize(slot + 64, CarCategory::Count);
+            branchOfSlot.resize(slot + 64, noBranch);
+        }
+        categoryOfSlot[slot] = category;
+        branchOfSlot[slot] = (uint16_t)car.branch;
+        nameOfSlot.push_back(internName(car.name));
+        carSchedules.emplace_back();
+
+        vector<uint64_t> &members = categorySchedules[(int)category].members;
+        members.resize(slot / 64 + 1, 0);
+        members[slot / 64] |= uint64_t(1) << (slot % 64);
+
+        for (AtomicBitset &bits : availableByCategory)
+            bits.grow(slot + 1);
+        if (available)
+            availableByCategory[(int)category].set(slot);
+        return true;
+    }
+
+    size_t size() const
+    {
+        return ids.size();
+    }
+
+    size_t slotOf(int carId) const
+    {
+        auto it = slotById.find(carId);
+        return it == slotById.end() ? npos : it->second;
+    }
+
+    CarView at(size_t slot) const
+    {
+        return CarView(*this, slot);
+    }
+
+    int idOf(size_t slot) const
+    {
+        return ids[slot];
+    }
+
+    int branchOf(size_t slot) const
+    {
+        return branchOfSlot[slot];
+    }
+
+    string_view nameOf(size_t slot) const
+    {
+        return names[nameOfSlot[slot]];
+    }
+
+    CarCategory categoryOf(size_t slot) const
+    {
+        return categoryOfSlot[slot];
+    }
+
+    bool isAvailable(size_t slot) const
+    {
+        return availableByCategory[(int)categoryOfSlot[slot]].test(slot);
+    }
+
+    // Marks the car booked; false if it was already booked.
+    bool tryClaim(size_t slot)
+    {
+        return availableByCategory[(int)categoryOfSlot[slot]].clear(slot);
+    }
+
+    // Marks the car available again; false if it was not booked.
+    bool release(size_t slot)
+    {
+        return !availableByCategory[(int)categoryOfSlot[slot]].set(slot);
+    }
+
+    // Reserves [start, end) on the car's calendar. With pickUpNow the car
+    // also leaves the lot, so it must be available right now as well.
+    bool reserve(size_t slot, long long start, long long end, const string &customer, bool pickUpNow)
+    {
+        CarSchedule &schedule = carSchedules[slot];
+        lock_guard<SpinLock> guard(schedule.lock);
+        if (start >= end || !schedule.calendar.isFree(start, end))
+            return false;
+        if (pickUpNow && !tryClaim(slot))
+            return false;
+        schedule.calendar.reserve(start, end, customer);
+        if (log)
+        {
+            log->append(LogRecordType::Reserve, (int32_t)ids[slot], (int64_t)start, (int64_t)end,
+                        (uint8_t)pickUpNow, customer);
+            WriteAheadLog::undoIfLost([this, slot, start, pickUpNow]()
+                                      { cancelReservation(slot, start, pickUpNow); });
+        }
+
+        ScheduleShard &shard = shardOf(slot);
+        lock_guard<mutex> shardGuard(shard.lock);
+        shard.reservations.emplace(start, make_pair(end, slot));
+        shard.longest = max(shard.longest, end - start);
+        return true;
+    }
+
+    long long freeHoursFrom(size_t slot, long long now)
+    {
+        CarSchedule &schedule = carSchedules[slot];
+        lock_guard<SpinLock> guard(schedule.lock);
+        return schedule.calendar.freeFrom(now);
+    }
+
+    // The car is back: make it available and cut its current reservation
+    // short. False if the car was not out.
+    bool finishRental(size_t slot, long long now)
+    {
+        CarSchedule &schedule = carSchedules[slot];
+        lock_guard<SpinLock> guard(schedule.lock);
+        if (!release(slot))
+            return false;
+        Reservation before{-1, -1, string()};
+        bool cut = schedule.calendar.finishAt(now, before);
+        if (log)
+        {
+            log->append(LogRecordType::Return, (int32_t)ids[slot], (int64_t)now);
+            WriteAheadLog::undoIfLost([this, slot, now, before]()
+                                      { undoReturn(slot, now, before); });
+        }
+        if (!cut)
+            return true;
+
+        ScheduleShard &shard = shardOf(slot);
+        lock_guard<mutex> shardGuard(shard.lock);
+        auto it = shardEntry(shard, before.start, slot);
+        if (it == shard.reservations.end())
+            return true;
+        if (before.start >= now)
+            shard.reservations.erase(it);
+        else
+            it->second.first = now;
+        return true;
+    }
+
+    // Takes back a reserve() whose log record was lost.
+    void cancelReservation(size_t slot, long long start, bool pickedUp)
+    {
+        CarSchedule &schedule = carSchedules[slot];
+        lock_guard<SpinLock> guard(schedule.lock);
+        schedule.calendar.cancel(start);
+        if (pickedUp)
+            release(slot);
+        ScheduleShard &shard = shardOf(slot);
+        lock_guard<mutex> shardGuard(shard.lock);
+        auto it = shardEntry(shard, start, slot);
+        if (it != shard.reservations.end())
+            shard.reservations.erase(it);
+    }
+
+    // Takes back a finishRental() at `now` whose log record was lost: the
+    // car is out again on the reservation it cut short, if there was one.
+    void undoReturn(size_t slot, long long now, const Reservation &before)
+    {
+        CarSchedule &schedule = carSchedules[slot];
+        lock_guard<SpinLock> guard(schedule.lock);
+        tryClaim(slot);
+        if (before.start < 0)
+            return;
+        schedule.calendar.restore(before);
+        ScheduleShard &shard = shardOf(slot);
+        lock_guard<mutex> shardGuard(shard.lock);
+        auto it = shardEntry(shard, before.start, slot);
+        if (it != shard.reservations.end())
+            it->second.first = before.end;
+        else if (before.start >= now)
+            shard.reservations.emplace(before.start, make_pair(before.end, slot));
+    }
+
+    // Slots of the category with nothing reserved in [start, end).
+    vector<size_t> freeCars(const string &category, long long start, long long end)
+    {
+        vector<size_t> result;
+        int index = categoryId(category);
+        if (index < 0)
+            return result;
+
+        CategorySchedule &schedule = categorySchedules[index];
+        vector<uint64_t> free = schedule.members;
+        for (ScheduleShard &shard : schedule.shards)
+        {
+            lock_guard<mutex> guard(shard.lock);
+            auto it = shard.reservations.upper_bound(start - shard.longest);
+            for (; it != shard.reservations.end() && it->first < end; ++it)
+            {
+                if (it->second.first > start)
+                {
+                    size_t slot = it->second.second;
+                    free[slot / 64] &= ~(uint64_t(1) << (slot % 64));
+                }
+            }
+        }
+        for (size_t w = 0; w < free.size(); w++)
+        {
+            for (uint64_t word = free[w]; word; word &= word - 1)
+                result.push_back(w * 64 + lowestSetBit(word));
+        }
+        return result;
+    }
+
+    template <typename Fn>
+    void forEachReservation(size_t slot, long long from, Fn fn)
+    {
+        CarSchedule &schedule = carSchedules[slot];
+        lock_guard<SpinLock> guard(schedule.lock);
+        schedule.calendar.forEachFrom(from, fn);
+    }
+
+    // Calls fn(car) for every available car of the category, optionally
+    // only those of one branch.
+    template <typename Fn>
+    void forEachAvailable(const string &category, Fn fn, int branch = anyBranch) const
+    {
+        int index = categoryId(category);
+        if (index < 0)
+            return;
+        const AtomicBitset &bits = availableByCategory[index];
+        for (size_t w = 0; w < bits.wordsUsed(); w++)
+        {
+            uint64_t word = bits.word(w);
+            if (word && branch != anyBranch)
+                word &= branchMask(w, branch);
+            while (word)
+            {
+                fn(at(w * 64 + lowestSetBit(word)));
+                word &= word - 1;
+            }
+        }
+    }
+
+    // Cars as id, category, availability, branch and name id columns plus
+    // the name table, then every reservation as a (slot, start, end) column
+    // plus customer names.
+    void writeSnapshot(SnapshotWriter &out)
+    {
+        size_t count = ids.size();
+        vector<uint8_t> categories(count), available(count);
+        vector<Span> spans;
+        vector<string> customers;
+        for (size_t slot = 0; slot < count; slot++)
+        {
+            categories[slot] = (uint8_t)categoryOfSlot[slot];
+            available[slot] = isAvailable(slot);
+            forEachReservation(slot, LLONG_MIN, [&](const Reservation &reservation)
+                               {
+                                   spans.push_back(Span{slot, reservation.start, reservation.end});
+                                   customers.push_back(reservation.customer);
+                               });
+        }
+        out.putVector(ids);
+        out.putVector(categories);
+        out.putVector(available);
+        out.putVector(vector<uint16_t>(branchOfSlot.begin(), branchOfSlot.begin() + count));
+        out.putVector(nameOfSlot);
+        out.put<uint64_t>(names.size());
+        for (const string &name : names)
+            out.putString(name);
+        out.putVector(spans);
+        for (const string &customer : customers)
+            out.putString(customer);
+    }
+
+    // Only valid on an empty store.
+    bool readSnapshot(SnapshotCursor &in)
+    {
+        vector<int> savedIds;
+        vector<uint8_t> categories, available;
+        vector<uint16_t> branches;
+        vector<uint32_t> nameIdsBySlot;
+        if (!in.getVector(savedIds) || !in.getVector(categories) || !in.getVector(available) ||
+            !in.getVector(branches) || !in.getVector(nameIdsBySlot) || categories.size() != savedIds.size() ||
+            available.size() != savedIds.size() || branches.size() != savedIds.size() ||
+            nameIdsBySlot.size() != savedIds.size())
+            return false;
+        uint64_t nameCount = in.get<uint64_t>();
+        vector<string> savedNames;
+        for (uint64_t i = 0; i < nameCount && in.ok(); i++)
+            savedNames.emplace_back(in.getString());
+        if (!in.ok())
+            return false;
+
+        ids.reserve(savedIds.size());
+        nameOfSlot.reserve(savedIds.size());
+        slotById.reserve(savedIds.size());
+        for (size_t i = 0; i < savedIds.size(); i++)
+        {
+            if (categories[i] >= categoryCount || nameIdsBySlot[i] >= savedNames.size() ||
+                !addCar(Car(savedIds[i], categoryName((CarCategory)categories[i]), savedNames[nameIdsBySlot[i]], branches[i]),
+                        available[i] != 0))
+                return false;
+        }
+
+        vector<Span> spans;
+        if (!in.getVector(spans))
+            return false;
+        for (const Span &span : spans)
+        {
+            string_view customer = in.getString();
+            if (span.slot >= ids.size() || !reserve(span.slot, span.start, span.end, string(customer), false))
+                return false;
+        }
+        return in.ok();
+    }
+
+    // Available cars of the category, optionally in one branch.
+    size_t countAvailable(const string &category, int branch = anyBranch) const
+    {
+        int index = categoryId(category);
+        if (index < 0)
+            return 0;
+        const AtomicBitset &bits = availableByCategory[index];
+        size_t count = 0;
+        for (size_t w = 0; w < bits.wordsUsed(); w++)
+        {
+            uint64_t word = bits.word(w);
+            if (word && branch != anyBranch)
+                word &= branchMask(w, branch);
+            count += popCount(word);
+        }
+        return count;
+    }
+
+    // All cars of the category (-1 = any) in the branch (anyBranch = any),
+    // available or not.
+    size_t countCars(int category, int branch) const
+    {
+        size_t count = 0;
+        for (size_t w = 0; w < categoryOfSlot.size() / 64; w++)
+        {
+            const uint8_t *categories = (const uint8_t *)&categoryOfSlot[w * 64];
+            uint64_t word = category >= 0 ? equalMask64(categories, (uint8_t)category)
+                                          : ~equalMask64(categories, (uint8_t)CarCategory::Count);
+            if (branch != anyBranch)
+                word &= branchMask(w, branch);
+            count += popCount(word);
+        }
+        return count;
+    }
+};
+
+inline int CarView::id() const
+{
+    return fleet->idOf(slot);
+}
+
+inline CarCategory CarView::category() const
+{
+    return fleet->categoryOf(slot);
+}
+
+inline int CarView::branch() const
+{
+    return fleet->branchOf(slot);
+}
+
+inline string_view CarView::name() const
+{
+    return fleet->nameOf(slot);
+}
+
+class Customer
+{
+public:
+    string name;
+    string license;
+    string aadhar;
+    string mobileNumber;
+
+    Customer(string name, string license, string aadhar, string mobileNumber)
+    {
+        this->name = name;
+        this->license = license;
+        this->aadhar = aadhar;
+        this->mobileNumber = mobileNumber;
+    }
+};
+struct CustomerRecord
+{
+    string_view name;
+    string_view license;
+    string_view aadhar;
+    string_view mobileNumber;
+};
+
+// Fields that identify a customer; no two customers may share one.
+enum class CustomerKey : uint8_t
+{
+    License,
+    Aadhar,
+    Mobile,
+    Count
+};
+
+const int customerKeyCount = (int)CustomerKey::Count;
+
+inline string_view customerKeyName(CustomerKey key)
+{
+    static const char *const names[] = {"license", "Aadhar", "mobile number"};
+    return names[(int)key];
+}
+
+inline string_view customerKeyOf(const CustomerRecord &record, CustomerKey key)
+{
+    return key == CustomerKey::License ? record.license : key == CustomerKey::Aadhar ? record.aadhar : record.mobileNumber;
+}
+
+// FNV-1a with the key type folded into the seed, so equal strings in
+// different fields hash apart.
+inline uint64_t customerKeyHash(CustomerKey key, string_view value)
+{
+    uint64_t hash = 0xcbf29ce484222325ull ^ ((uint64_t)key + 1) * 0x9E3779B97F4A7C15ull;
+    for (char c : value)
+        hash = (hash ^ (unsigned char)c) * 0x100000001B3ull;
+    return hash ^ (hash >> 29);
+}
+
+// Blocked Bloom filter: each key sets probes bits inside one 64-byte block,
+// so a lookup touches a single cache line. At 10 bits per key that gives
+// about 1% false positives up to capacity().
+class BloomFilter
+{
+    static constexpr int probes = 7;
+    static constexpr size_t bitsPerKey = 10;
+    static constexpr size_t blockWords = 8;
+
+    vector<uint64_t> words;
+    size_t keys = 0;
+    size_t limit = 0;
+
+public:
+    void reset(size_t expectedKeys)
+    {
+        limit = max<size_t>(expectedKeys, 1024);
+        size_t blocks = (limit * bitsPerKey + 511) / 512;
+        words.assign(blocks * blockWords, 0);
+        keys = 0;
+    }
+
+    size_t capacity() const
+    {
+        return limit;
+    }
+
+    size_t size() const
+    {
+        return keys;
+    }
+
+    void add(uint64_t hash)
+    {
+        uint64_t *block = &words[(size_t)((hash >> 32) % (words.size() / blockWords)) * blockWords];
+        uint32_t step = (uint32_t)hash | 1;
+        for (int i = 0; i < probes; i++)
+        {
+            uint32_t bit = ((uint32_t)hash + i * step) % 512;
+            block[bit / 64] |= uint64_t(1) << (bit % 64);
+        }
+        keys++;
+    }
+
+    bool mayContain(uint64_t hash) const
+    {
+        if (words.empty())
+            return false;
+        const uint64_t *block = &words[(size_t)((hash >> 32) % (words.size() / blockWords)) * blockWords];
+        uint32_t step = (uint32_t)hash | 1;
+        for (int i = 0; i < probes; i++)
+        {
+            uint32_t bit = ((uint32_t)hash + i * step) % 512;
+            if (!(block[bit / 64] & (uint64_t(1) << (bit % 64))))
+                return false;
+        }
+        return true;
+    }
+};
+
+// Login index over customers.txt. The file is mapped once and every record's
+// fields are views into the mapping; customers registered later are stored in
+// a deque so their views stay valid as it grows. License, Aadhar and mobile
+// number share one open-addressing table mapping each value to the first
+// customer using it; slots keep the full hash, so probes rarely touch the
+// records. A Bloom filter over the same keys sits in front, so checking a
+// new customer usually ends at the filter.
+class CustomerIndex
+{
+    struct LoginKeyHash
+    {
+        size_t operator()(const pair<string_view, string_view> &key) const
+        {
+            size_t h = hash<string_view>()(key.first);
+            return h ^ (hash<string_view>()(key.second) + 0x9e3779b9 + (h << 6) + (h >> 2));
+        }
+    };
+
+    MappedFile file;
+    deque<string> addedLines;
+    deque<CustomerRecord> records;
+    unordered_map<pair<string_view, string_view>, size_t, LoginKeyHash> byLogin;
+    struct KeySlot
+    {
+        uint64_t hash;
+        uint32_t record;
+        uint32_t key;
+    };
+
+    static const uint32_t emptySlot = UINT32_MAX;
+
+    vector<KeySlot> keySlots;
+    size_t keysUsed = 0;
+    BloomFilter seenKeys;
+    size_t duplicates = 0;
+
+    // Slot holding value for key, or the empty slot where it would go.
+    size_t probe(CustomerKey key, string_view value, uint64_t hash) const
+    {
+        size_t mask = keySlots.size() - 1;
+        for (size_t at = (size_t)hash & mask;; at = (at + 1) & mask)
+        {
+            const KeySlot &slot = keySlots[at];
+            if (slot.record == emptySlot ||
+                (slot.hash == hash && slot.key == (uint32_t)key && customerKeyOf(records[slot.record], key) == value))
+                return at;
+        }
+    }
+
+    void resizeKeys(size_t slots)
+    {
+        vector<KeySlot> old(slots, KeySlot{0, emptySlot, 0});
+        old.swap(keySlots);
+        size_t mask = keySlots.size() - 1;
+        for (const KeySlot &slot : old)
+        {
+            if (slot.record == emptySlot)
+                continue;
+            size_t at = (size_t)slot.hash & mask;
+            while (keySlots[at].record != emptySlot)
+                at = (at + 1) & mask;
+            keySlots[at] = slot;
+        }
+    }
+
+    // False if another record already holds value for key.
+    bool insertKey(CustomerKey key, string_view value, uint32_t record)
+    {
+        if (2 * (keysUsed + 1) > keySlots.size())
+            resizeKeys(max<size_t>(1024, 2 * keySlots.size()));
+        uint64_t hash = customerKeyHash(key, value);
+        size_t at = probe(key, value, hash);
+        if (keySlots[at].record != emptySlot)
+            return false;
+        keySlots[at] = KeySlot{hash, record, (uint32_t)key};
+        keysUsed++;
+        if (seenKeys.size() >= seenKeys.capacity())
+            growFilter();
+        seenKeys.add(hash);
+        return true;
+    }
+
+    // Empties slot `at` and moves later entries of its probe run back into
+    // the hole, so lookups that passed through it still find them.
+    void eraseKeySlot(size_t at)
+    {
+        size_t mask = keySlots.size() - 1;
+        for (size_t next = (at + 1) & mask; keySlots[next].record != emptySlot; next = (next + 1) & mask)
+        {
+            size_t home = (size_t)keySlots[next].hash & mask;
+            if (((next - home) & mask) >= ((next - at) & mask))
+            {
+                keySlots[at] = keySlots[next];
+                at = next;
+            }
+        }
+        keySlots[at].record = emptySlot;
+        keysUsed--;
+    }
+
+    static CustomerRecord parseLine(string_view line)
+    {
+        string_view fields[4];
+        for (int i = 0; i < 4; i++)
+        {
+            size_t comma = i < 3 ? line.find(',') : string_view::npos;
+            fields[i] = line.substr(0, comma);
+            line = comma == string_view::npos ? string_view() : line.substr(comma + 1);
+        }
+        return CustomerRecord{fields[0], fields[1], fields[2], fields[3]};
+    }
+
+    // Doubles the filter and re-adds every key once it is full, so adds stay
+    // amortised O(1).
+    void growFilter()
+    {
+        seenKeys.reset(2 * seenKeys.capacity());
+        for (const KeySlot &slot : keySlots)
+        {
+            if (slot.record != emptySlot)
+                seenKeys.add(slot.hash);
+        }
+    }
+
+    void index(const CustomerRecord &record)
+    {
+        records.push_back(record);
+        size_t position = records.size() - 1;
+        byLogin.emplace(make_pair(record.name, record.license), position);
+        bool duplicate = false;
+        for (int key = 0; key < customerKeyCount; key++)
+        {
+            string_view value = customerKeyOf(record, (CustomerKey)key);
+            if (!value.empty() && !insertKey((CustomerKey)key, value, (uint32_t)position))
+                duplicate = true;
+        }
+        duplicates += duplicate;
+    }
+
+public:
+    CustomerIndex() = default;
+    CustomerIndex(const CustomerIndex &) = delete;
+    CustomerIndex &operator=(const CustomerIndex &) = delete;
+
+    bool load(const string &path)
+    {
+        byLogin.clear();
+        keySlots.clear();
+        keysUsed = 0;
+        records.clear();
+        addedLines.clear();
+        duplicates = 0;
+        seenKeys.reset(0);
+        if (!file.open(path))
+            return false;
+
+        string_view data = file.view();
+        size_t lines = count(data.begin(), data.end(), '\n') + 1;
+        byLogin.reserve(lines);
+        size_t slots = 1024;
+        while (slots < 2 * customerKeyCount * lines)
+            slots *= 2;
+        resizeKeys(slots);
+        seenKeys.reset(customerKeyCount * lines);
+        while (!data.empty())
+        {
+            size_t newline = data.find('\n');
+            string_view line = data.substr(0, newline);
+            data = newline == string_view::npos ? string_view() : data.substr(newline + 1);
+            if (!line.empty() && line.back() == '\r')
+                line.remove_suffix(1);
+            if (!line.empty())
+                index(parseLine(line));
+        }
+        return true;
+    }
+
+    bool isLoaded() const
+    {
+        return file.isOpen();
+    }
+
+    size_t size() const
+    {
+        return records.size();
+    }
+
+    const CustomerRecord *find(string_view name, string_view license) const
+    {
+        auto it = byLogin.find(make_pair(name, license));
+        return it == byLogin.end() ? nullptr : &records[it->second];
+    }
+
+    // The customer already holding value for key, if any.
+    const CustomerRecord *findByKey(CustomerKey key, string_view value) const
+    {
+        if (value.empty())
+            return nullptr;
+        uint64_t hash = customerKeyHash(key, value);
+        if (!seenKeys.mayContain(hash))
+            return nullptr;
+        const KeySlot &slot = keySlots[probe(key, value, hash)];
+        return slot.record == emptySlot ? nullptr : &records[slot.record];
+    }
+
+    // First identifying field of customer that another customer already
+    // uses; CustomerKey::Count if there is none.
+    CustomerKey conflictOf(const Customer &customer) const
+    {
+        const string *values[customerKeyCount] = {&customer.license, &customer.aadhar, &customer.mobileNumber};
+        for (int key = 0; key < customerKeyCount; key++)
+        {
+            if (findByKey((CustomerKey)key, *values[key]))
+                return (CustomerKey)key;
+        }
+        return CustomerKey::Count;
+    }
+
+    // Records in the loaded file that reuse another record's license,
+    // Aadhar or mobile number.
+    size_t duplicateRecords() const
+    {
+        return duplicates;
+    }
+
+    const CustomerRecord &add(const Customer &customer)
+    {
+        addedLines.push_back(customer.name + "," + customer.license + "," + customer.aadhar + "," + customer.mobileNumber);
+        index(parseLine(addedLines.back()));
+        return records.back();
+    }
+
+    // Takes back add(customer). The record keeps its place in records but
+    // can no longer be found.
+    void remove(const Customer &customer)
+    {
+        auto it = byLogin.find(make_pair(string_view(customer.name), string_view(customer.license)));
+        if (it == byLogin.end())
+            return;
+        size_t position = it->second;
+        byLogin.erase(it);
+        for (int key = 0; key < customerKeyCount; key++)
+        {
+            string_view value = customerKeyOf(records[position], (CustomerKey)key);
+            if (value.empty())
+                continue;
+            size_t at = probe((CustomerKey)key, value, customerKeyHash((CustomerKey)key, value));
+            if (keySlots[at].record == position)
+                eraseKeySlot(at);
+        }
+    }
+};
+
+struct CustomerMerge
+{
+    size_t line;
+    size_t intoLine;
+    CustomerKey sharedKey;
+};
+
+// One pass over a customer file that folds every record sharing a license,
+// Aadhar or mobile number with an earlier one into the earliest of its
+// group, transitively. Each field value maps to the first record using it
+// and records are linked in a union-find rooted at the earliest member, so
+// the pass is linear in the file size. Fields the kept record lacks are
+// taken from the records merged into it. The file is rewritten through a
+// synced temporary and a rename, so it must not be open elsewhere.
+bool mergeDuplicateCustomers(const string &path, size_t &kept, vector<CustomerMerge> &merges)
+{
+    kept = 0;
+    merges.clear();
+    vector<CustomerRecord> records;
+    vector<size_t> lineOf;
+    string output;
+    {
+        MappedFile file;
+        if (!file.open(path))
+            return false;
+        string_view data = file.view();
+        for (size_t lineNumber = 1; !data.empty(); lineNumber++)
+        {
+            size_t newline = data.find('\n');
+            string_view line = data.substr(0, newline);
+            data = newline == string_view::npos ? string_view() : data.substr(newline + 1);
+            if (!line.empty() && line.back() == '\r')
+                line.remove_suffix(1);
+            if (line.empty())
+                continue;
+            string_view fields[4];
+            for (int i = 0; i < 4; i++)
+            {
+                size_t comma = i < 3 ? line.find(',') : string_view::npos;
+                fields[i] = line.substr(0, comma);
+                line = comma == string_view::npos ? string_view() : line.substr(comma + 1);
+            }
+            records.push_back(CustomerRecord{fields[0], fields[1], fields[2], fields[3]});
+            lineOf.push_back(lineNumber);
+        }
+
+        vector<size_t> parent(records.size());
+        vector<uint8_t> reason(records.size(), (uint8_t)CustomerKey::Count);
+        for (size_t i = 0; i < parent.size(); i++)
+            parent[i] = i;
+        auto root = [&parent](size_t i)
+        {
+            while (parent[i] != i)
+                i = parent[i] = parent[parent[i]];
+            return i;
+        };
+
+        for (int key = 0; key < customerKeyCount; key++)
+        {
+            unordered_map<string_view, size_t> firstWith;
+            firstWith.reserve(records.size());
+            for (size_t i = 0; i < records.size(); i++)
+            {
+                string_view value = customerKeyOf(records[i], (CustomerKey)key);
+                if (value.empty())
+                    continue;
+                auto inserted = firstWith.emplace(value, i);
+                if (inserted.second)
+                    continue;
+                size_t a = root(i), b = root(inserted.first->second);
+                if (a == b)
+                    continue;
+                parent[max(a, b)] = min(a, b);
+                if (reason[max(a, b)] == (uint8_t)CustomerKey::Count)
+                    reason[max(a, b)] = (uint8_t)key;
+            }
+        }
+
+        for (size_t i = 0; i < records.size(); i++)
+        {
+            size_t first = root(i);
+            if (first == i)
+            {
+                kept++;
+                continue;
+            }
+            CustomerRecord &into = records[first];
+            for (string_view CustomerRecord::*field : {&CustomerRecord::license, &CustomerRecord::aadhar, &CustomerRecord::mobileNumber})
+            {
+                if ((into.*field).empty())
+                    into.*field = records[i].*field;
+            }
+            merges.push_back({lineOf[i], lineOf[first], (CustomerKey)reason[i]});
+        }
+
+        output.reserve(file.size());
+        for (size_t i = 0; i < records.size(); i++)
+        {
+            if (root(i) != i)
+                continue;
+            const CustomerRecord &record = records[i];
+            output.append(record.name).append(",").append(record.license).append(",");
+            output.append(record.aadhar).append(",").append(record.mobileNumber).append("\n");
+        }
+    }
+    if (merges.empty())
+        return true;
+
+    string temporary = path + ".tmp";
+    {
+        ofstream out(temporary, ios::binary | ios::trunc);
+        out.write(output.data(), output.size());
+        if (!out.flush())
+            return false;
+    }
+    if (!syncFileToDisk(temporary))
+        return false;
+#ifdef _WIN32
+    remove(path.c_str());
+#endif
+    return rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+struct RentalCompany
+{
+    string name;
+    string address;
+    string city;
+    string pincode;
+    double latitude;
+    double longitude;
+};
+
+// Branch lookup by location. Branches are stored as points on the unit
+// sphere in an implicit k-d tree (the median of each range is its root), so
+// straight-line distance orders them exactly like road-agnostic great-circle
+// distance and whole subtrees are skipped once they cannot beat the current
+// k-th best. Pincodes go into a digit trie over the branches sorted by
+// pincode, so every trie node owns a contiguous range and a prefix lookup is
+// one walk down at most six levels.
+class BranchLocator
+{
+    static constexpr double earthRadiusKm = 6371.0;
+
+    struct Point
+    {
+        double xyz[3];
+        size_t branch;
+    };
+
+    struct TrieNode
+    {
+        int child[10];
+        size_t first, last;
+    };
+
+    vector<RentalCompany> branches;
+    vector<Point> tree;
+    vector<size_t> byPincode;
+    vector<TrieNode> trie;
+
+    static void toPoint(double latitude, double longitude, double *xyz)
+    {
+        const double radians = 3.14159265358979323846 / 180.0;
+        double lat = latitude * radians, lon = longitude * radians;
+        xyz[0] = cos(lat) * cos(lon);
+        xyz[1] = cos(lat) * sin(lon);
+        xyz[2] = sin(lat);
+    }
+
+    static double chordToKm(double chord)
+    {
+        return 2.0 * earthRadiusKm * asin(min(1.0, chord / 2.0));
+    }
+
+    static double kmToChord(double km)
+    {
+        return km >= earthRadiusKm * 3.14159265358979323846 ? 2.0 : 2.0 * sin(km / (2.0 * earthRadiusKm));
+    }
+
+    void buildTree(size_t low, size_t high, int depth)
+    {
+        if (high - low <= 1)
+            return;
+        size_t middle = low + (high - low) / 2;
+        int axis = depth % 3;
+        nth_element(tree.begin() + low, tree.begin() + middle, tree.begin() + high,
+                    [axis](const Point &a, const Point &b)
+                    { return a.xyz[axis] < b.xyz[axis]; });
+        buildTree(low, middle, depth + 1);
+        buildTree(middle + 1, high, depth + 1);
+    }
+
+    // best is a max-heap on squared chord length holding at most k entries.
+    void search(size_t low, size_t high, int depth, const double *target, size_t k, double limit2,
+                vector<pair<double, size_t>> &best) const
+    {
+        while (low < high)
+        {
+            size_t middle = low + (high - low) / 2;
+            const Point &point = tree[middle];
+            double d2 = 0;
+            for (int i = 0; i < 3; i++)
+                d2 += (point.xyz[i] - target[i]) * (point.xyz[i] - target[i]);
+            if (d2 <= limit2)
+            {
+                if (best.size() < k)
+                {
+                    best.emplace_back(d2, point.branch);
+                    push_heap(best.begin(), best.end());
+                }
+                else if (d2 < best.front().first)
+                {
+                    pop_heap(best.begin(), best.end());
+                    best.back() = {d2, point.branch};
+                    push_heap(best.begin(), best.end());
+                }
+            }
+
+            int axis = depth % 3;
+            double delta = target[axis] - point.xyz[axis];
+            size_t nearLow = delta < 0 ? low : middle + 1, nearHigh = delta < 0 ? middle : high;
+            size_t farLow = delta < 0 ? middle + 1 : low, farHigh = delta < 0 ? high : middle;
+            search(nearLow, nearHigh, depth + 1, target, k, limit2, best);
+
+            double bound = best.size() < k ? limit2 : min(limit2, best.front().first);
+            if (delta * delta > bound)
+                return;
+            low = farLow;
+            high = farHigh;
+            depth++;
+        }
+    }
+
+    int newTrieNode(size_t first)
+    {
+        TrieNode node;
+        fill(begin(node.child), end(node.child), -1);
+        node.first = first;
+        node.last = first;
+        trie.push_back(node);
+        return (int)trie.size() - 1;
+    }
+
+public:
+    BranchLocator() {}
+
+    explicit BranchLocator(vector<RentalCompany> companies)
+    {
+        assign(move(companies));
+    }
+
+    void assign(vector<RentalCompany> companies)
+    {
+        branches = move(companies);
+        tree.assign(branches.size(), Point());
+        for (size_t i = 0; i < branches.size(); i++)
+        {
+            toPoint(branches[i].latitude, branches[i].longitude, tree[i].xyz);
+            tree[i].branch = i;
+        }
+        buildTree(0, tree.size(), 0);
+
+        byPincode.resize(branches.size());
+        for (size_t i = 0; i < byPincode.size(); i++)
+            byPincode[i] = i;
+        sort(byPincode.begin(), byPincode.end(), [this](size_t a, size_t b)
+             { return branches[a].pincode < branches[b].pincode; });
+
+        trie.clear();
+        newTrieNode(0);
+        for (size_t i = 0; i < byPincode.size(); i++)
+        {
+            int node = 0;
+            trie[node].last = i + 1;
+            for (char c : branches[byPincode[i]].pincode)
+            {
+                if (c < '0' || c > '9')
+                    break;
+                int next = trie[node].child[c - '0'];
+                if (next < 0)
+                {
+                    next = newTrieNode(i);
+                    trie[node].child[c - '0'] = next;
+                }
+                node = next;
+                trie[node].last = i + 1;
+            }
+        }
+    }
+
+    size_t size() const
+    {
+        return branches.size();
+    }
+
+    void writeSnapshot(SnapshotWriter &out) const
+    {
+        vector<double> coordinates;
+        for (const RentalCompany &company : branches)
+        {
+            coordinates.push_back(company.latitude);
+            coordinates.push_back(company.longitude);
+        }
+        out.putVector(coordinates);
+        for (const RentalCompany &company : branches)
+        {
+            out.putString(company.name);
+            out.putString(company.address);
+            out.putString(company.city);
+            out.putString(company.pincode);
+        }
+    }
+
+    bool readSnapshot(SnapshotCursor &in)
+    {
+        vector<double> coordinates;
+        if (!in.getVector(coordinates) || coordinates.size() % 2)
+            return false;
+        vector<RentalCompany> companies(coordinates.size() / 2);
+        for (size_t i = 0; i < companies.size(); i++)
+        {
+            RentalCompany &company = companies[i];
+            company.name = in.getString();
+            company.address = in.getString();
+            company.city = in.getString();
+            company.pincode = in.getString();
+            company.latitude = coordinates[2 * i];
+            company.longitude = coordinates[2 * i + 1];
+        }
+        if (!in.ok())
+            return false;
+        assign(move(companies));
+        return true;
+    }
+
+    const RentalCompany &branch(size_t index) const
+    {
+        return branches[index];
+    }
+
+    // Up to k branches within maxKm of the point, nearest first, as
+    // (distance in km, branch index).
+    vector<pair<double, size_t>> nearest(double latitude, double longitude, size_t k, double maxKm) const
+    {
+        vector<pair<double, size_t>> best;
+        if (k == 0 || tree.empty())
+            return best;
+        double target[3];
+        toPoint(latitude, longitude, target);
+        double limit = kmToChord(maxKm);
+        search(0, tree.size(), 0, target, k, limit * limit, best);
+
+        sort_heap(best.begin(), best.end());
+        for (auto &entry : best)
+            entry.first = chordToKm(sqrt(entry.first));
+        return best;
+    }
+
+    // Branches whose pincode starts with prefix. matched receives the length
+    // of the longest prefix of the input that any branch shares; the result
+    // holds the branches sharing that much.
+    vector<size_t> byPincodePrefix(const string &prefix, size_t &matched) const
+    {
+        int node = 0;
+        matched = 0;
+        for (char c : prefix)
+        {
+            if (c < '0' || c > '9' || trie[node].child[c - '0'] < 0)
+                break;
+            node = trie[node].child[c - '0'];
+            matched++;
+        }
+        return vector<size_t>(byPincode.begin() + trie[node].first, byPincode.begin() + trie[node].last);
+    }
+};
+
+// Lists the branches nearest to the customer. The customer is placed at the
+// branch in their city, or failing that at the branches sharing the longest
+// pincode prefix with theirs, so a pincode one over still finds its
+// neighbours instead of nothing.
+void printNearbyRentalCompanies(string userCity, string pincode, const BranchLocator &locator,
+                                size_t count = 5, double maxKm = 500)
+{
+    cout << "\n--- Nearby Rental Companies ---\n";
+
+    size_t matched = 0;
+    vector<size_t> anchors = locator.byPincodePrefix(pincode, matched);
+    vector<size_t> inCity;
+    for (size_t index : anchors)
+    {
+        if (locator.branch(index).city == userCity)
+            inCity.push_back(index);
+    }
+    if (!inCity.empty())
+        anchors = inCity;
+    if (matched == 0 && inCity.empty())
+        anchors.clear();
+
+    if (anchors.empty())
+    {
+        cout << "No rental companies found in your city and district.\n";
+        return;
+    }
+
+    double latitude = 0, longitude = 0;
+    for (size_t index : anchors)
+    {
+        latitude += locator.branch(index).latitude;
+        longitude += locator.branch(index).longitude;
+    }
+    latitude /= anchors.size();
+    longitude /= anchors.size();
+
+    for (const auto &entry : locator.nearest(latitude, longitude, count, maxKm))
+    {
+        const RentalCompany &company = locator.branch(entry.second);
+        cout << "Company Name: " << company.name << endl;
+        cout << "Address: " << company.address << endl;
+        cout << "City: " << company.city << ", pincode: " << company.pincode << endl;
+        cout << "Distance: " << fixed << setprecision(1) << entry.first << " km" << defaultfloat << setprecision(6) << endl;
+        cout << "-------------------------------\n";
+    }
+}
+
+// Customers waiting for a car category, kept in one FIFO per priority level
+// and hours bucket; bucket b holds requests for [2^b, 2^(b+1)) hours and the
+// last one everything longer. A car free for the next `freeHours` can serve
+// every request in the buckets starting at or below that, so a dispatch
+// looks only at the front of each such bucket and takes the oldest front
+// that fits: a constant number of comparisons, with no scan of the queues.
+// A request behind a front that does not fit waits for a longer gap.
+// Requests past their deadline are discarded lazily as they reach a front.
+class DispatchEngine
+{
+public:
+    static constexpr int priorityLevels = 3;
+    static constexpr int hourBuckets = 16;
+
+    struct Request
+    {
+        string customer;
+        int priority;
+        long long hours;
+        chrono::steady_clock::time_point deadline;
+        uint64_t sequence;
+    };
+
+private:
+    struct CategoryQueues
+    {
+        deque<Request> buckets[priorityLevels][hourBuckets];
+        uint32_t nonEmpty[priorityLevels] = {};
+    };
+
+    unordered_map<string, CategoryQueues> byCategory;
+    uint64_t nextSequence = 0;
+    mutable mutex lock;
+
+    static int bucketOf(long long hours)
+    {
+        return min(highestSetBit((uint64_t)max(hours, 1LL)), hourBuckets - 1);
+    }
+
+    void push(CategoryQueues &queues, Request &&request, bool atFront)
+    {
+        int bucket = bucketOf(request.hours);
+        queues.nonEmpty[request.priority] |= 1u << bucket;
+        deque<Request> &queue = queues.buckets[request.priority][bucket];
+        if (atFront)
+            queue.push_front(move(request));
+        else
+            queue.push_back(move(request));
+    }
+
+public:
+    // priority 0 is served first; a zero timeout waits indefinitely.
+    void addRequest(const string &category, const string &customer, int priority, long long hours, chrono::seconds timeout)
+    {
+        priority = min(max(priority, 0), priorityLevels - 1);
+        auto deadline = timeout.count() > 0 ? chrono::steady_clock::now() + timeout
+                                            : chrono::steady_clock::time_point::max();
+        lock_guard<mutex> guard(lock);
+        push(byCategory[category], Request{customer, priority, hours, deadline, nextSequence++}, false);
+    }
+
+    // Removes and returns the oldest unexpired request for category, highest
+    // priority first, that asks for at most freeHours.
+    bool serveFirst(const string &category, long long freeHours, Request &served)
+    {
+        lock_guard<mutex> guard(lock);
+        auto it = byCategory.find(category);
+        if (it == byCategory.end())
+            return false;
+        CategoryQueues &queues = it->second;
+        auto now = chrono::steady_clock::now();
+        for (int level = 0; level < priorityLevels; level++)
+        {
+            deque<Request> *best = nullptr;
+            int bestBucket = 0;
+            for (uint32_t bits = queues.nonEmpty[level]; bits; bits &= bits - 1)
+            {
+                int bucket = lowestSetBit(bits);
+                if ((1LL << bucket) > freeHours)
+                    break;
+                deque<Request> &queue = queues.buckets[level][bucket];
+                while (!queue.empty() && queue.front().deadline <= now)
+                    queue.pop_front();
+                if (queue.empty())
+                {
+                    queues.nonEmpty[level] &= ~(1u << bucket);
+                    continue;
+                }
+                if (queue.front().hours <= freeHours &&
+                    (!best || queue.front().sequence < best->front().sequence))
+                {
+                    best = &queue;
+                    bestBucket = bucket;
+                }
+            }
+            if (best)
+            {
+                served = move(best->front());
+                best->pop_front();
+                if (best->empty())
+                    queues.nonEmpty[level] &= ~(1u << bestBucket);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Puts a request taken by serveFirst back at the head of its queue.
+    void restore(const string &category, Request request)
+    {
+        lock_guard<mutex> guard(lock);
+        push(byCategory[category], move(request), true);
+    }
+
+    size_t waiting(const string &category) const
+    {
+        lock_guard<mutex> guard(lock);
+        auto it = byCategory.find(category);
+        if (it == byCategory.end())
+            return 0;
+        size_t count = 0;
+        for (const auto &level : it->second.buckets)
+            for (const deque<Request> &queue : level)
+                count += queue.size();
+        return count;
+    }
+
+    // Recovery: a logged pick-up by customer means their request, if still
+    // queued from the snapshot, was served.
+    void forget(const string &category, const string &customer)
+    {
+        lock_guard<mutex> guard(lock);
+        auto it = byCategory.find(category);
+        if (it == byCategory.end())
+            return;
+        for (int level = 0; level < priorityLevels; level++)
+        {
+            for (int bucket = 0; bucket < hourBuckets; bucket++)
+            {
+                deque<Request> &queue = it->second.buckets[level][bucket];
+                for (auto request = queue.begin(); request != queue.end(); ++request)
+                {
+                    if (request->customer != customer)
+                        continue;
+                    queue.erase(request);
+                    if (queue.empty())
+                        it->second.nonEmpty[level] &= ~(1u << bucket);
+                    return;
+                }
+            }
+        }
+    }
+
+    // Unexpired requests, oldest first, with the seconds each has left
+    // (0 = no limit), since a steady_clock deadline means nothing to the
+    // process that loads the snapshot.
+    void writeSnapshot(SnapshotWriter &out) const
+    {
+        lock_guard<mutex> guard(lock);
+        auto now = chrono::steady_clock::now();
+        vector<pair<const string *, const Request *>> live;
+        for (const auto &entry : byCategory)
+        {
+            for (const auto &level : entry.second.buckets)
+            {
+                for (const deque<Request> &queue : level)
+                {
+                    for (const Request &request : queue)
+                    {
+                        if (request.deadline > now)
+                            live.emplace_back(&entry.first, &request);
+                    }
+                }
+            }
+        }
+        sort(live.begin(), live.end(), [](const auto &a, const auto &b)
+             { return a.second->sequence < b.second->sequence; });
+        out.put<uint64_t>(live.size());
+        for (const auto &entry : live)
+        {
+            const Request &request = *entry.second;
+            long long seconds = request.deadline == chrono::steady_clock::time_point::max()
+                                    ? 0
+                                    : chrono::ceil<chrono::seconds>(request.deadline - now).count();
+            out.putString(*entry.first);
+            out.putString(request.customer);
+            out.put<int32_t>(request.priority);
+            out.put<int64_t>(request.hours);
+            out.put<int64_t>(seconds);
+        }
+    }
+
+    bool readSnapshot(SnapshotCursor &in)
+    {
+        uint64_t count = in.get<uint64_t>();
+        for (uint64_t i = 0; i < count && in.ok(); i++)
+        {
+            string category(in.getString()), customer(in.getString());
+            int priority = in.get<int32_t>();
+            long long hours = in.get<int64_t>();
+            long long seconds = in.get<int64_t>();
+            if (in.ok())
+                addRequest(category, customer, priority, hours, chrono::seconds(seconds));
+        }
+        return in.ok();
+    }
+};
+
+struct QuoteRequest
+{
+    int carId;
+    RateType type;
+    int64_t duration;
+};
+
+struct RentalResult
+{
+    bool ok;
+    optional<CarView> car;
+    long long start;
+    long long end;
+    Money price;
+};
+
+struct ReturnResult
+{
+    bool ok;
+    optional<CarView> car;
+    string dispatchedTo;
+};
+
+struct WaitlistResult
+{
+    optional<CarView> bookedCar;
+    size_t waiting;
+};
+
+struct RegistrationResult
+{
+    bool ok;
+    bool saved;
+    CustomerKey conflict;
+};
+
+class CarRentalSystem
+{
+private:
+    FleetStore fleet;
+    CustomerIndex customerIndex;
+    DispatchEngine dispatcher;
+    RateCalendar rates;
+    ofstream customerFile;
+    WriteAheadLog *log = nullptr;
+
+    // Waits for the log to hold a successful change; false if it failed.
+    bool committed(bool ok)
+    {
+        return ok && (!log || log->commit());
+    }
+
+    // Prices for the public quote and booking calls, which record the metric.
+    Money calendarPrice(int carId, long long start, long long end) const
+    {
+        size_t slot = fleet.slotOf(carId);
+        if (slot == FleetStore::npos)
+            return -1;
+        return rates.quote(fleet.categoryOf(slot), start, end);
+    }
+
+    // Day rentals start at the beginning of the day holding `hour`, hour
+    // rentals at `hour`.
+    Money priceFrom(size_t slot, RateType type, int64_t duration, long long hour) const
+    {
+        if (slot == FleetStore::npos || type >= RateType::Count || duration <= 0)
+            return -1;
+        long long start = type == RateType::Day ? hour / 24 * 24 : hour;
+        return rates.quote(fleet.categoryOf(slot), start, start + rentalHours(type, duration));
+    }
+
+    Money priceFromNow(int carId, RateType type, int64_t duration) const
+    {
+        return priceFrom(fleet.slotOf(carId), type, duration, currentHour());
+    }
+
+    // A car just became free: hand it to the first waiting customer of its
+    // category whose hours it can cover; customers it cannot serve, say
+    // because their hours run into a later reservation, keep waiting.
+    // Returns that customer, or "" if nobody got it.
+    string dispatchFreedCar(size_t slot)
+    {
+        long long now = currentHour();
+        string category = categoryName(fleet.categoryOf(slot));
+        DispatchEngine::Request request;
+        if (!dispatcher.serveFirst(category, fleet.freeHoursFrom(slot, now), request))
+            return string();
+        if (!fleet.reserve(slot, now, now + request.hours, request.customer, true))
+        {
+            // Someone booked the car since freeHoursFrom looked.
+            dispatcher.restore(category, move(request));
+            return string();
+        }
+        if (log)
+        {
+            // Should the log lose this reservation, the fleet takes it back
+            // and the customer goes back to the head of the queue.
+            WriteAheadLog::undoIfLost([this, category, request]()
+                                      { dispatcher.restore(category, request); });
+        }
+        if (!committed(true))
+            return string();
+        return request.customer;
+    }
+
+public:
+    // Without the default fleet the cars are expected to come from a
+    // snapshot; see readSnapshot.
+    explicit CarRentalSystem(bool withDefaultFleet = true)
+        : rates(standardRateCalendar(currentHour() / 24 - 1, 2 * 366 + 1))
+    {
+        customerIndex.load("customers.txt");
+        if (withDefaultFleet)
+            addDefaultFleet();
+    }
+
+    void addDefaultFleet()
+    {
+        fleet.addCar(Car(1, "SUV", "Toyota Fortuner"));
+        fleet.addCar(Car(2, "Sedan", "Honda City"));
+        fleet.addCar(Car(3, "Hatchback", "Maruti Swift"));
+        fleet.addCar(Car(4, "SUV", "Hyundai Creta"));
+        fleet.addCar(Car(5, "Sedan", "Tata Tiago"));
+        fleet.addCar(Car(6, "Hatchback", "Hyundai i20"));
+        fleet.addCar(Car(7, "SUV", "Mahindra Scorpio"));
+        fleet.addCar(Car(8, "Sedan", "Maruti Suzuki Swift"));
+        fleet.addCar(Car(9, "Hatchback", "Ford Figo"));
+        fleet.addCar(Car(10, "SUV", "Tata Nexon"));
+        fleet.addCar(Car(11, "Sedan", "Toyota Corolla"));
+        fleet.addCar(Car(12, "SUV", "Mahindra Thar"));
+        fleet.addCar(Car(13, "Hatchback", "Renault Kwid"));
+        fleet.addCar(Car(14, "SUV", "Kia Seltos"));
+        fleet.addCar(Car(15, "SUV", "Skoda Kushaq"));
+        fleet.addCar(Car(16, "Sedan", "BMW 3 Series"));
+        fleet.addCar(Car(17, "Hatchback", "Volkswagen Polo"));
+        fleet.addCar(Car(18, "SUV", "Nissan X-Trail"));
+        fleet.addCar(Car(19, "Sedan", "Audi A4"));
+        fleet.addCar(Car(20, "SUV", "Jeep Compass"));
+        fleet.addCar(Car(21, "SUV", "Ford Endeavour"));
+        fleet.addCar(Car(22, "Sedan", "Mercedes-Benz C-Class"));
+        fleet.addCar(Car(23, "Hatchback", "Suzuki Baleno"));
+        fleet.addCar(Car(24, "SUV", "Land Rover Range Rover"));
+        fleet.addCar(Car(25, "Sedan", "Hyundai Elantra"));
+        fleet.addCar(Car(26, "Hatchback", "Honda Jazz"));
+        fleet.addCar(Car(27, "SUV", "Volkswagen Tiguan"));
+        fleet.addCar(Car(28, "Sedan", "Jaguar XF"));
+        fleet.addCar(Car(29, "Hatchback", "Chevrolet Spark"));
+        fleet.addCar(Car(30, "SUV", "BMW X5"));
+        fleet.addCar(Car(31, "Sedan", "Audi Q5"));
+        fleet.addCar(Car(32, "Hatchback", "Maruti Celerio"));
+        fleet.addCar(Car(33, "SUV", "Toyota Land Cruiser"));
+        fleet.addCar(Car(34, "Sedan", "Skoda Superb"));
+        fleet.addCar(Car(35, "Hatchback", "Tata Altroz"));
+        fleet.addCar(Car(36, "SUV", "Mahindra XUV300"));
+        fleet.addCar(Car(37, "Sedan", "Honda Accord"));
+        fleet.addCar(Car(38, "Hatchback", "Ford Fiesta"));
+        fleet.addCar(Car(39, "SUV", "Jeep Wrangler"));
+        fleet.addCar(Car(40, "Sedan", "Mercedes-Benz E-Class"));
+        fleet.addCar(Car(41, "SUV", "Porsche Cayenne"));
+        fleet.addCar(Car(42, "Hatchback", "Renault Triber"));
+        fleet.addCar(Car(43, "Sedan", "Volvo S90"));
+        fleet.addCar(Car(44, "SUV", "Tata Harrier"));
+        fleet.addCar(Car(45, "Sedan", "Honda City ZX"));
+        fleet.addCar(Car(46, "SUV", "Hyundai Tucson"));
+        fleet.addCar(Car(47, "Hatchback", "Nissan Micra"));
+        fleet.addCar(Car(48, "SUV", "Audi Q7"));
+        fleet.addCar(Car(49, "Sedan", "BMW 5 Series"));
+        fleet.addCar(Car(50, "SUV", "Kia Sonet"));
+        fleet.addCar(Car(51, "Sedan", "Chevrolet Cruze"));
+        fleet.addCar(Car(52, "Hatchback", "Datsun Redi-Go"));
+        fleet.addCar(Car(53, "SUV", "Renault Duster"));
+        fleet.addCar(Car(54, "Sedan", "Toyota Camry"));
+        fleet.addCar(Car(55, "SUV", "Nissan Patrol"));
+        fleet.addCar(Car(56, "Hatchback", "Suzuki Wagon R"));
+        fleet.addCar(Car(57, "SUV", "MG Hector"));
+        fleet.addCar(Car(58, "Sedan", "Lexus ES"));
+        fleet.addCar(Car(59, "SUV", "Honda CR-V"));
+        fleet.addCar(Car(60, "Hatchback", "Tata Nano"));
+    }
+
+    bool addCar(const Car &car)
+    {
+        return fleet.addCar(car);
+    }
+
+    // Customers stay in customers.txt, which is already mapped in place.
+    // Waiting dispatch requests go to a section of their own.
+    void writeSnapshot(SnapshotWriter &out)
+    {
+        fleet.writeSnapshot(out);
+    }
+
+    bool readSnapshot(SnapshotCursor &in)
+    {
+        return fleet.size() == 0 && fleet.readSnapshot(in);
+    }
+
+    void writeDispatchSnapshot(SnapshotWriter &out)
+    {
+        dispatcher.writeSnapshot(out);
+    }
+
+    bool readDispatchSnapshot(SnapshotCursor &in)
+    {
+        return dispatcher.readSnapshot(in);
+    }
+
+    // Registrations, reservations and returns are logged from now on and
+    // each call returns only once its change is durable.
+    void attachLog(WriteAheadLog *journal)
+    {
+        log = journal;
+        fleet.attachLog(journal);
+    }
+
+    // Recovery: re-applies a logged reservation or return as recorded.
+    bool replayReservation(int carId, const string &customer, long long start, long long end, bool pickUpNow)
+    {
+        size_t slot = fleet.slotOf(carId);
+        if (slot == FleetStore::npos || !fleet.reserve(slot, start, end, customer, pickUpNow))
+            return false;
+        if (pickUpNow)
+            dispatcher.forget(categoryName(fleet.categoryOf(slot)), customer);
+        return true;
+    }
+
+    bool replayReturn(int carId, long long at)
+    {
+        size_t slot = fleet.slotOf(carId);
+        return slot != FleetStore::npos && fleet.finishRental(slot, at);
+    }
+
+    // Thread-safe booking core. Booking reserves [now, now + hours) on the
+    // car's calendar and claims its availability bit under the car's own
+    // lock, so concurrent sessions can never book the same car twice.
+    bool tryBookCar(int carId, const string &customer, long long hours)
+    {
+        OperationTimer timer(Metric::Book);
+        size_t slot = fleet.slotOf(carId);
+        long long now = currentHour();
+        return committed(slot != FleetStore::npos && fleet.reserve(slot, now, now + hours, customer, true));
+    }
+
+    bool tryReturnCar(int carId)
+    {
+        OperationTimer timer(Metric::Return);
+        size_t slot = fleet.slotOf(carId);
+        return committed(slot != FleetStore::npos && fleet.finishRental(slot, currentHour()));
+    }
+
+    // Reserves the car for a later period without taking it off the lot.
+    bool tryReserveCar(int carId, const string &customer, long long start, long long end)
+    {
+        OperationTimer timer(Metric::Book);
+        size_t slot = fleet.slotOf(carId);
+        return committed(slot != FleetStore::npos && fleet.reserve(slot, start, end, customer, false));
+    }
+
+    vector<CarView> findFreeCars(const string &category, long long start, long long end)
+    {
+        vector<size_t> slots = fleet.freeCars(category, start, end);
+        vector<CarView> result;
+        result.reserve(slots.size());
+        for (size_t slot : slots)
+            result.push_back(fleet.at(slot));
+        return result;
+    }
+
+    // Calendar price of renting carId over [start, end) in hours, with weekend
+    // and seasonal rates; -1 if the car is unknown or the period is outside
+    // the rate calendar.
+    Money quoteRange(int carId, long long start, long long end) const
+    {
+        OperationTimer timer(Metric::Quote);
+        return calendarPrice(carId, start, end);
+    }
+
+    static long long rentalHours(RateType type, int64_t duration)
+    {
+        return type == RateType::Day ? 24 * duration : duration;
+    }
+
+    // Price of a rental starting now. Day rentals are priced from the start
+    // of today, hour rentals from the current hour; -1 if the car is unknown,
+    // the duration is not positive or the period is beyond the rate calendar.
+    Money priceRental(int carId, RateType type, int64_t duration) const
+    {
+        OperationTimer timer(Metric::Quote);
+        return priceFromNow(carId, type, duration);
+    }
+
+    // priceRental for count requests into out, reading the clock and
+    // recording the metric once per call.
+    void quoteBatch(const QuoteRequest *requests, size_t count, Money *out) const
+    {
+        OperationTimer timer(Metric::Quote);
+        long long hour = currentHour();
+        for (size_t i = 0; i < count; i++)
+            out[i] = priceFrom(fleet.slotOf(requests[i].carId), requests[i].type, requests[i].duration, hour);
+    }
+
+    optional<CarView> findCar(int carId) const
+    {
+        size_t slot = fleet.slotOf(carId);
+        if (slot == FleetStore::npos)
+            return nullopt;
+        return fleet.at(slot);
+    }
+
+    bool isCarAvailable(int carId) const
+    {
+        size_t slot = fleet.slotOf(carId);
+        return slot != FleetStore::npos && fleet.isAvailable(slot);
+    }
+
+    // Available cars of the category, optionally only in one branch.
+    vector<CarView> availableCars(const string &category, int branch = FleetStore::anyBranch) const
+    {
+        vector<CarView> result;
+        fleet.forEachAvailable(category, [&result](const CarView &car)
+        {
+            result.push_back(car);
+        }, branch);
+        return result;
+    }
+
+    size_t countAvailable(const string &category, int branch = FleetStore::anyBranch) const
+    {
+        return fleet.countAvailable(category, branch);
+    }
+
+    // Cars of the category in the branch whether booked or not; a null
+    // category or anyBranch leaves that filter out.
+    size_t countCars(const char *category, int branch = FleetStore::anyBranch) const
+    {
+        CarCategory parsed;
+        if (category && !parseCategory(category, parsed))
+            return 0;
+        return fleet.countCars(category ? (int)parsed : -1, branch);
+    }
+
+    bool customersLoaded() const
+    {
+        return customerIndex.isLoaded();
+    }
+
+    size_t duplicateCustomers() const
+    {
+        return customerIndex.duplicateRecords();
+    }
+
+    bool tryLoginCustomer(const string &name, const string &license) const
+    {
+        OperationTimer timer(Metric::Login);
+        return customerIndex.find(name, license) != nullptr;
+    }
+
+    bool saveCustomer(const Customer &customer)
+    {
+        if (!customerFile.is_open())
+            customerFile.open("customers.txt", ios::app);
+        customerFile << customer.name << "," << customer.license << "," << customer.aadhar << "," << customer.mobileNumber << "\n";
+        customerFile.flush();
+        if (customerFile)
+            return true;
+        customerFile.close();
+        customerFile.clear();
+        return false;
+    }
+
+    // Logs and indexes the customer and appends them to customers.txt.
+    // Refused when another customer already has the same license, Aadhar
+    // or mobile number (conflict says which); not ok if the log failed, not
+    // saved if customers.txt could not be written. Inside a DeferredCommit
+    // the line is only written once the log commit succeeds, so saved is
+    // reported up front and a failed write goes to stderr.
+    RegistrationResult registerCustomer(const Customer &customer)
+    {
+        OperationTimer timer(Metric::Register);
+        RegistrationResult result = {false, false, customerIndex.conflictOf(customer)};
+        if (result.conflict != CustomerKey::Count)
+            return result;
+        customerIndex.add(customer);
+        if (log)
+        {
+            log->append(LogRecordType::Register, customer.name, customer.license, customer.aadhar, customer.mobileNumber);
+            WriteAheadLog::undoIfLost([this, customer]()
+                                      { customerIndex.remove(customer); });
+            if (WriteAheadLog::deferring())
+            {
+                WriteAheadLog::onceDurable([this, customer]()
+                {
+                    if (!saveCustomer(customer))
+                        cerr << "Could not add " << customer.name << " to customers.txt.\n";
+                });
+                result.ok = result.saved = true;
+                return result;
+            }
+            if (!log->commit())
+                return result;
+        }
+        result.ok = true;
+        result.saved = saveCustomer(customer);
+        return result;
+    }
+
+    // Takes the car now for duration days or hours.
+    RentalResult bookCar(int carId, const string &customer, RateType type, int64_t duration)
+    {
+        OperationTimer timer(Metric::Book);
+        RentalResult result = {false, findCar(carId), currentHour(), 0, priceFromNow(carId, type, duration)};
+        result.end = result.start + rentalHours(type, duration);
+        if (!result.car || duration <= 0)
+            return result;
+        result.ok = committed(fleet.reserve(fleet.slotOf(carId), result.start, result.end, customer, true));
+        return result;
+    }
+
+    RentalResult reserveCar(int carId, const string &customer, long long start, long long end)
+    {
+        OperationTimer timer(Metric::Book);
+        RentalResult result = {false, findCar(carId), start, end, calendarPrice(carId, start, end)};
+        result.ok = result.car && committed(fleet.reserve(fleet.slotOf(carId), start, end, customer, false));
+        return result;
+    }
+
+    // Returns the car and hands it straight to the next waiting customer of
+    // its category, if there is one.
+    ReturnResult returnCar(int carId)
+    {
+        ReturnResult result = {tryReturnCar(carId), findCar(carId), string()};
+        if (result.ok)
+            result.dispatchedTo = dispatchFreedCar(fleet.slotOf(carId));
+        return result;
+    }
+
+    // Books a free car of the category right away if there is one, otherwise
+    // queues the customer until a car is returned or the timeout passes
+    // (0 = no limit).
+    WaitlistResult joinWaitlist(const string &category, const string &customer, int priority, long long hours,
+                                chrono::seconds timeout)
+    {
+        OperationTimer timer(Metric::Waitlist);
+        long long now = currentHour();
+        for (size_t slot : fleet.freeCars(category, now, now + hours))
+        {
+            if (fleet.reserve(slot, now, now + hours, customer, true))
+            {
+                if (!committed(true))
+                    return WaitlistResult{nullopt, 0};
+                return WaitlistResult{fleet.at(slot), 0};
+            }
+        }
+        dispatcher.addRequest(category, customer, priority, hours, timeout);
+        return WaitlistResult{nullopt, dispatcher.waiting(category)};
+    }
+
+    vector<Reservation> upcomingReservations(int carId)
+    {
+        vector<Reservation> result;
+        size_t slot = fleet.slotOf(carId);
+        if (slot != FleetStore::npos)
+        {
+            fleet.forEachReservation(slot, currentHour(), [&result](const Reservation &reservation)
+            {
+                result.push_back(reservation);
+            });
+        }
+        return result;
+    }
+};
+
+// Console front end for customers: reads the prompts, calls the
+// CarRentalSystem API and prints what it returns.
+class CustomerConsole
+{
+    CarRentalSystem &system;
+
+public:
+    explicit CustomerConsole(CarRentalSystem &system) : system(system) {}
+
+    void displayRates()
+    {
+        cout << "===============================================\n";
+        cout << " Categories of Cars in our system are: \n";
+        cout << " 1. SUV   | 2. Sedan   | 3. Hatchback\n";
+        cout << "===============================================\n";
+
+        cout << " Car Category    | Daily Wages      | Hourly Wages   \n";
+        cout << "-------------------------------------------------------\n";
+        for (int c = 0; c < categoryCount; c++)
+        {
+            cout << setw(16) << categoryName((CarCategory)c)
+                 << setw(20) << formatMoney(rateTable[c][(int)RateType::Day])
+                 << setw(15) << formatMoney(rateTable[c][(int)RateType::Hour]) << endl;
+        }
+        cout << "===============================================\n";
+    }
+
+    void calculateRentalPrice(int carId, string rentalType, int hoursOrDays)
+    {
+        optional<CarView> car = system.findCar(carId);
+        if (!car)
+        {
+            cout << "Car ID not found!\n";
+            return;
+        }
+        RateType type;
+        Money price = 0;
+        if (parseRateType(rentalType, type))
+        {
+            price = system.priceRental(carId, type, hoursOrDays);
+            if (price < 0)
+            {
+                cout << "Rental period is beyond our rate calendar!\n";
+                return;
+            }
+        }
+
+        cout << "Car Name: " << car->name() << endl;
+        cout << "Category: " << categoryName(car->category()) << endl;
+        cout << "Rental Type: " << rentalType << endl;
+        cout << "Total Rental Price: " << formatMoney(price) << endl;
+    }
+
+    void loginCustomer()
+    {
+        string name, license;
+        cout << "\nEnter your name: ";
+        cin.ignore();
+        getline(cin, name);
+        cout << "Enter your license: ";
+        getline(cin, license);
+
+        if (system.tryLoginCustomer(name, license))
+        {
+            cout << "Login successful! Welcome, " << name << ".\n";
+        }
+        else if (!system.customersLoaded())
+        {
+            cout << "Error opening customer data file.\n";
+        }
+        else
+        {
+            cout << "Login failed. Customer not found.\n";
+        }
+    }
+
+    void displayCars(string category)
+    {
+        cout << "\nAvailable cars in category '" << category << "':\n";
+        for (const CarView &car : system.availableCars(category))
+            cout << "ID: " << car.id() << ", Name: " << car.name() << "\n";
+    }
+
+    void registerCustomer()
+    {
+        string name, license, aadhar, mobileNumber;
+        cout << "\nEnter customer details:\n";
+        cout << "Name: ";
+        cin.ignore();
+        getline(cin, name);
+        cout << "License: ";
+        getline(cin, license);
+        cout << "Aadhar: ";
+        getline(cin, aadhar);
+        cout << "Mobile Number: ";
+        getline(cin, mobileNumber);
+
+        RegistrationResult result = system.registerCustomer(Customer(name, license, aadhar, mobileNumber));
+        if (result.conflict != CustomerKey::Count)
+        {
+            cout << "A customer with this " << customerKeyName(result.conflict) << " is already registered.\n";
+        }
+        else if (!result.ok)
+        {
+            cout << "Error saving customer data.\n";
+        }
+        else if (result.saved)
+        {
+            cout << "Customer registered successfully and saved to file!\n";
+        }
+        else
+        {
+            cout << "Customer registered successfully!\n";
+            cout << "Error saving customer data to file.\n";
+        }
+    }
+
+    void bookCar()
+    {
+        string rentalType;
+        int hoursOrDays;
+        int carId;
+        string customerName;
+
+        cout << "\nEnter your name: ";
+        cin.ignore();
+        getline(cin, customerName);
+        cout << "Enter Car ID to book: ";
+        cin >> carId;
+
+        cout << "Do you want to rent the car for a day or hour? (Enter 'day' or 'hour'): ";
+        cin >> rentalType;
+
+        cout << "How many " << (rentalType == "day" ? "days" : "hours") << " do you want to rent the car for? ";
+        cin >> hoursOrDays;
+
+        RateType type;
+        if (!parseRateType(rentalType, type))
+        {
+            cout << "Invalid rental type!\n";
+            return;
+        }
+        calculateRentalPrice(carId, rentalType, hoursOrDays);
+
+        RentalResult result = system.bookCar(carId, customerName, type, hoursOrDays);
+        if (result.ok)
+        {
+            cout << "Car '" << result.car->name() << "' booked successfully by " << customerName << "!\n";
+            return;
+        }
+        cout << "Car not available for that period or invalid ID!\n";
+    }
+
+    void reserveCar()
+    {
+        string customerName;
+        int carId;
+        long long startOffset, hours;
+        cout << "\nEnter your name: ";
+        cin.ignore();
+        getline(cin, customerName);
+        cout << "Enter Car ID to reserve: ";
+        cin >> carId;
+        cout << "Start in how many hours from now? ";
+        cin >> startOffset;
+        cout << "For how many hours? ";
+        cin >> hours;
+
+        long long start = currentHour() + startOffset;
+        RentalResult result = system.reserveCar(carId, customerName, start, start + hours);
+        if (result.ok)
+        {
+            cout << "Car '" << result.car->name() << "' reserved for " << customerName << " from "
+                 << formatHour(result.start) << " to " << formatHour(result.end) << ".\n";
+            if (result.price >= 0)
+                cout << "Estimated price: " << formatMoney(result.price) << endl;
+            return;
+        }
+        cout << "Car already reserved in that period or invalid ID!\n";
+    }
+
+    void displayFreeCars()
+    {
+        string category;
+        long long startOffset, hours;
+        cout << "\nEnter car category (SUV/Sedan/Hatchback): ";
+        cin >> category;
+        cout << "Start in how many hours from now? ";
+        cin >> startOffset;
+        cout << "For how many hours? ";
+        cin >> hours;
+
+        long long start = currentHour() + startOffset;
+        cout << "\n" << category << " cars free from " << formatHour(start) << " to " << formatHour(start + hours) << ":\n";
+        for (const CarView &car : system.findFreeCars(category, start, start + hours))
+            cout << "ID: " << car.id() << ", Name: " << car.name() << "\n";
+    }
+
+    void returnCar()
+    {
+        int carId;
+        cout << "\nEnter Car ID to return: ";
+        cin >> carId;
+
+        ReturnResult result = system.returnCar(carId);
+        if (result.ok)
+        {
+            cout << "Car '" << result.car->name() << "' returned successfully!\n";
+            if (!result.dispatchedTo.empty())
+                cout << "Car '" << result.car->name() << "' booked for waiting customer " << result.dispatchedTo << "!\n";
+            return;
+        }
+        cout << "Invalid Car ID or the car is already available!\n";
+    }
+
+    void joinWaitlist()
+    {
+        string customerName, category;
+        int priority, minutes;
+        long long hours;
+        cout << "\nEnter your name: ";
+        cin.ignore();
+        getline(cin, customerName);
+        cout << "Enter car category (SUV/Sedan/Hatchback): ";
+        cin >> category;
+        cout << "For how many hours do you need the car? ";
+        cin >> hours;
+        cout << "Priority (1 = high, 2 = normal, 3 = low): ";
+        cin >> priority;
+        cout << "How many minutes are you willing to wait? (0 = no limit): ";
+        cin >> minutes;
+
+        CarCategory parsed;
+        if (!parseCategory(category, parsed) || hours <= 0 || priority < 1 || priority > 3)
+        {
+            cout << "Invalid category, hours or priority!\n";
+            return;
+        }
+        WaitlistResult result = system.joinWaitlist(category, customerName, priority - 1, hours,
+                                                    chrono::minutes(max(minutes, 0)));
+        if (result.bookedCar)
+        {
+            cout << "Car '" << result.bookedCar->name() << "' is available now and was booked by " << customerName << "!\n";
+            return;
+        }
+        cout << customerName << " added to the " << category << " waitlist (" << result.waiting << " waiting).\n";
+    }
+
+    void usageDetails()
+    {
+        int carId;
+        cout << "\nEnter Car ID to check details: ";
+        cin >> carId;
+
+        optional<CarView> car = system.findCar(carId);
+        if (!car)
+        {
+            cout << "Car not found!\n";
+            return;
+        }
+        cout << "Car Name: " << car->name() << ", Category: " << categoryName(car->category())
+             << ", Availability: " << (system.isCarAvailable(carId) ? "Available" : "Not Available") << endl;
+        for (const Reservation &reservation : system.upcomingReservations(carId))
+        {
+            cout << "  Reserved by " << reservation.customer << ": " << formatHour(reservation.start)
+                 << " to " << formatHour(reservation.end) << "\n";
+        }
+    }
+};
+
+vector<RentalCompany> defaultRentalCompanies()
+{
+    return {
+        {"Mumbai Car Rentals", "123 Marine Drive, Mumbai", "Mumbai", "400020", 18.9322, 72.8264},
+        {"Delhi Wheels", "456 Connaught Place, New Delhi", "New Delhi", "110001", 28.6315, 77.2167},
+        {"Bangalore Speedy Rentals", "789 MG Road, Bengaluru", "Bengaluru", "560001", 12.9756, 77.6050},
+        {"Hyderabad Quick Rentals", "101 Banjara Hills, Hyderabad", "Hyderabad", "500034", 17.4156, 78.4347},
+        {"Chennai CityX Rentals", "202 Anna Salai, Chennai", "Chennai", "600002", 13.0604, 80.2496},
+        {"Kolkata Prime Rentals", "303 Park Street, Kolkata", "Kolkata", "700016", 22.5535, 88.3524},
+        {"Pune Drive Rentals", "404 FC Road, Pune", "Pune", "411005", 18.5236, 73.8412},
+        {"Ahmedabad Auto Rentals", "505 CG Road, Ahmedabad", "Ahmedabad", "380009", 23.0300, 72.5600},
+        {"Jaipur PinkCity Rentals", "606 MI Road, Jaipur", "Jaipur", "302001", 26.9170, 75.8040},
+        {"Lucknow Urban Rentals", "707 Hazratganj, Lucknow", "Lucknow", "226001", 26.8500, 80.9462},
+        {"Chandigarh City Rentals", "808 Sector 17, Chandigarh", "Chandigarh", "160017", 30.7398, 76.7827},
+        {"Indore Fast Rentals", "909 MG Road, Indore", "Indore", "452001", 22.7196, 75.8577},
+        {"Bhopal Eco Rentals", "101 New Market, Bhopal", "Bhopal", "462003", 23.2332, 77.4010},
+        {"Thiruvananthapuram Rentals", "202 MG Road, Thiruvananthapuram", "Thiruvananthapuram", "695001", 8.5000, 76.9500},
+        {"Guwahati Speed Rentals", "303 GS Road, Guwahati", "Guwahati", "781005", 26.1600, 91.7700},
+        {"Nagpur Orange Rentals", "404 Civil Lines, Nagpur", "Nagpur", "440001", 21.1590, 79.0830},
+        {"Visakhapatnam Rentals", "505 Beach Road, Visakhapatnam", "Visakhapatnam", "530001", 17.7140, 83.3230},
+        {"Patna Smart Rentals", "606 Gandhi Maidan, Patna", "Patna", "800001", 25.6130, 85.1450},
+        {"Vadodara Car Rentals", "707 Alkapuri, Vadodara", "Vadodara", "390007", 22.3120, 73.1650},
+        {"Surat Rentals", "808 Ring Road, Surat", "Surat", "395003", 21.1860, 72.8310},
+        {"Kanpur Ride Rentals", "909 Mall Road, Kanpur", "Kanpur", "208001", 26.4730, 80.3500},
+        {"Coimbatore Fast Rentals", "101 Avinashi Road, Coimbatore", "Coimbatore", "641018", 11.0170, 76.9900},
+        {"Madurai Quick Rentals", "202 Meenakshi Amman Temple Road, Madurai", "Madurai", "625001", 9.9195, 78.1193},
+        {"Ranchi Drive Rentals", "303 Main Road, Ranchi", "Ranchi", "834001", 23.3600, 85.3300},
+        {"Raipur Rentals", "404 Pandri, Raipur", "Raipur", "492001", 21.2430, 81.6390},
+        {"Mysuru Rentals", "505 Devaraja Market, Mysuru", "Mysuru", "570001", 12.3050, 76.6550},
+        {"Varanasi Rentals", "606 Assi Ghat Road, Varanasi", "Varanasi", "221005", 25.2900, 83.0060},
+        {"Agra City Rentals", "707 Taj Road, Agra", "Agra", "282001", 27.1700, 78.0420},
+        {"Amritsar Rentals", "808 Golden Temple Road, Amritsar", "Amritsar", "143001", 31.6200, 74.8760},
+        {"Meerut Car Rentals", "909 Shastri Nagar, Meerut", "Meerut", "250001", 28.9845, 77.7064}};
+}
+
+// Everything the menus work on. It is restored from one snapshot at startup
+// and saved back on exit, so a restart does not rebuild anything by hand.
+struct SystemState
+{
+    ConcurrentWaitlist waitlist{16384};
+    ActionStack actions;
+    Graph rentalLocations;
+    BookingHistory history;
+    VehicleTree inventory;
+    CarRentalSystem rentals{false};
+    BranchLocator branches;
+    WriteAheadLog log;
+};
+
+const char *const snapshotPath = "rental.snap";
+const char *const logPath = "rental.wal";
+const char *const metricsPath = "metrics.jsonl";
+const uint64_t logCompactionBytes = 64 << 20;
+
+// Re-applies the logged changes the snapshot does not hold yet (those
+// numbered above covered), then keeps logging to the same file.
+void recoverFromLog(SystemState &state, uint64_t covered)
+{
+    uint64_t validBytes, lastSequence;
+    size_t replayed = 0;
+    WriteAheadLog::replay(logPath, [&](uint64_t sequence, LogRecordType type, SnapshotCursor &fields)
+    {
+        if (sequence <= covered)
+            return;
+        replayed++;
+        if (type == LogRecordType::Register)
+        {
+            string name(fields.getString()), license(fields.getString());
+            string aadhar(fields.getString()), mobile(fields.getString());
+            if (fields.ok())
+                state.rentals.registerCustomer(Customer(name, license, aadhar, mobile));
+        }
+        else if (type == LogRecordType::Reserve)
+        {
+            int carId = fields.get<int32_t>();
+            long long start = fields.get<int64_t>(), end = fields.get<int64_t>();
+            bool pickUpNow = fields.get<uint8_t>() != 0;
+            string customer(fields.getString());
+            if (fields.ok())
+                state.rentals.replayReservation(carId, customer, start, end, pickUpNow);
+        }
+        else if (type == LogRecordType::Return)
+        {
+            int carId = fields.get<int32_t>();
+            long long at = fields.get<int64_t>();
+            if (fields.ok())
+                state.rentals.replayReturn(carId, at);
+        }
+        else if (type == LogRecordType::AddEdge)
+        {
+            string from(fields.getString()), to(fields.getString());
+            int distance = fields.get<int32_t>();
+            if (fields.ok())
+                state.rentalLocations.addEdge(from, to, distance);
+        }
+    }, validBytes, lastSequence);
+
+    if (replayed > 0)
+        cerr << "Recovered " << replayed << " logged changes from " << logPath << ".\n";
+    if (state.rentals.duplicateCustomers() > 0)
+        cerr << "customers.txt has " << state.rentals.duplicateCustomers()
+             << " duplicate customer records; run with --merge-customers to fold them.\n";
+    if (!state.log.open(logPath, validBytes, max(covered, lastSequence)))
+    {
+        cerr << "Cannot open " << logPath << "; changes will only be saved on exit.\n";
+        return;
+    }
+    state.rentals.attachLog(&state.log);
+    state.rentalLocations.attachLog(&state.log);
+}
+
+// Falls back to the built-in fleet and branches when the snapshot is
+// missing, from another version, or fails its checksum, then replays the
+// write-ahead log on top.
+unique_ptr<SystemState> loadSystemState(const string &path)
+{
+    unique_ptr<SystemState> state(new SystemState());
+    SnapshotReader reader;
+    uint64_t covered = 0;
+    if (reader.open(path))
+    {
+        auto restore = [&](SnapshotSection type, auto &target)
+        {
+            SnapshotCursor cursor;
+            return reader.section(type, cursor) && target.readSnapshot(cursor);
+        };
+        if (restore(SnapshotSection::Fleet, state->rentals) && restore(SnapshotSection::Inventory, state->inventory) &&
+            restore(SnapshotSection::Locations, state->rentalLocations) &&
+            restore(SnapshotSection::Waitlist, state->waitlist) && restore(SnapshotSection::Actions, state->actions) &&
+            restore(SnapshotSection::Branches, state->branches))
+        {
+            SnapshotCursor cursor, waiting;
+            if (reader.section(SnapshotSection::Dispatch, waiting) && !state->rentals.readDispatchSnapshot(waiting))
+                cerr << "Could not restore the dispatch queues from " << path << ".\n";
+            if (reader.section(SnapshotSection::Log, cursor))
+                covered = cursor.get<uint64_t>();
+            recoverFromLog(*state, cursor.ok() ? covered : 0);
+            return state;
+        }
+        reader.close();
+        state.reset();
+        state.reset(new SystemState());
+    }
+    state->rentals.addDefaultFleet();
+    state->branches.assign(defaultRentalCompanies());
+    recoverFromLog(*state, 0);
+    return state;
+}
+
+// Writes the snapshot, syncs it and then empties the log it supersedes.
+// Nothing may change the state while it runs.
+bool saveSystemState(const string &path, SystemState &state)
+{
+    SnapshotWriter out;
+    auto store = [&](SnapshotSection type, auto &source)
+    {
+        out.beginSection(type);
+        source.writeSnapshot(out);
+        out.endSection();
+    };
+    store(SnapshotSection::Fleet, state.rentals);
+    store(SnapshotSection::Inventory, state.inventory);
+    store(SnapshotSection::Locations, state.rentalLocations);
+    store(SnapshotSection::Waitlist, state.waitlist);
+    store(SnapshotSection::Actions, state.actions);
+    store(SnapshotSection::Branches, state.branches);
+    out.beginSection(SnapshotSection::Dispatch);
+    state.rentals.writeDispatchSnapshot(out);
+    out.endSection();
+    out.beginSection(SnapshotSection::Log);
+    out.put<uint64_t>(state.log.lastSequence());
+    out.endSection();
+    return out.save(path) && state.log.reset();
+}
+
+// Compaction: folds the log into a fresh snapshot once it grows past
+// logCompactionBytes, or once a write failed, since only the snapshot's
+// reset() lets the log take changes again. Same rule as saveSystemState
+// about concurrent changes.
+bool compactLogIfNeeded(SystemState &state)
+{
+    return (state.log.size() < logCompactionBytes && !state.log.hasFailed()) || saveSystemState(snapshotPath, state);
+}
+
+// One flat JSON object of string and number fields, the command format of
+// batch mode. Nested objects and arrays are rejected. Fields are kept in a
+// reused vector, so parsing a line allocates only for long values.
+class JsonFields
+{
+    struct Field
+    {
+        string key;
+        string value;
+        bool quoted;
+    };
+
+    vector<Field> fields;
+    size_t used = 0;
+
+    static void skipSpace(string_view text, size_t &at)
+    {
+        while (at < text.size() && (text[at] == ' ' || text[at] == '\t' || text[at] == '\r' || text[at] == '\n'))
+            at++;
+    }
+
+    static bool parseString(string_view text, size_t &at, string &out)
+    {
+        out.clear();
+        if (at >= text.size() || text[at] != '"')
+            return false;
+        for (at++; at < text.size(); at++)
+        {
+            char c = text[at];
+            if (c == '"')
+            {
+                at++;
+                return true;
+            }
+            if (c != '\\')
+            {
+                out += c;
+                continue;
+            }
+            if (++at >= text.size())
+                return false;
+            switch (text[at])
+            {
+            case 'n':
+                out += '\n';
+                break;
+            case 't':
+                out += '\t';
+                break;
+            case 'r':
+                out += '\r';
+                break;
+            case 'b':
+                out += '\b';
+                break;
+            case 'f':
+                out += '\f';
+                break;
+            case 'u':
+            {
+                unsigned code = 0;
+                if (at + 4 >= text.size() || from_chars(text.data() + at + 1, text.data() + at + 5, code, 16).ptr != text.data() + at + 5)
+                    return false;
+                at += 4;
+                if (code < 0x80)
+                    out += (char)code;
+                else if (code < 0x800)
+                {
+                    out += (char)(0xC0 | (code >> 6));
+                    out += (char)(0x80 | (code & 0x3F));
+                }
+                else
+                {
+                    out += (char)(0xE0 | (code >> 12));
+                    out += (char)(0x80 | ((code >> 6) & 0x3F));
+                    out += (char)(0x80 | (code & 0x3F));
+                }
+                break;
+            }
+            default:
+                out += text[at];
+            }
+        }
+        return false;
+    }
+
+    const Field *find(string_view key) const
+    {
+        for (size_t i = 0; i < used; i++)
+        {
+            if (fields[i].key == key)
+                return &fields[i];
+        }
+        return nullptr;
+    }
+
+public:
+    bool parse(string_view text)
+    {
+        used = 0;
+        size_t at = 0;
+        skipSpace(text, at);
+        if (at >= text.size() || text[at++] != '{')
+            return false;
+        skipSpace(text, at);
+        if (at < text.size() && text[at] == '}')
+            return true;
+        while (true)
+        {
+            if (used == fields.size())
+                fields.emplace_back();
+            Field &field = fields[used];
+            skipSpace(text, at);
+            if (!parseString(text, at, field.key))
+                return false;
+            skipSpace(text, at);
+            if (at >= text.size() || text[at++] != ':')
+                return false;
+            skipSpace(text, at);
+            if (at < text.size() && text[at] == '"')
+            {
+                if (!parseString(text, at, field.value))
+                    return false;
+                field.quoted = true;
+            }
+            else
+            {
+                size_t start = at;
+                while (at < text.size() && text[at] != ',' && text[at] != '}' && text[at] != ' ' && text[at] != '\t')
+                    at++;
+                field.value.assign(text.data() + start, at - start);
+                field.quoted = false;
+                if (field.value.empty() || field.value[0] == '{' || field.value[0] == '[')
+                    return false;
+            }
+            used++;
+            skipSpace(text, at);
+            if (at >= text.size())
+                return false;
+            if (text[at] == '}')
+                return true;
+            if (text[at++] != ',')
+                return false;
+        }
+    }
+
+    bool has(string_view key) const
+    {
+        return find(key) != nullptr;
+    }
+
+    bool getString(string_view key, string &out) const
+    {
+        const Field *field = find(key);
+        if (!field || !field->quoted)
+            return false;
+        out = field->value;
+        return true;
+    }
+
+    // Accepts numbers and numeric strings.
+    bool getInt(string_view key, long long &out) const
+    {
+        const Field *field = find(key);
+        if (!field)
+            return false;
+        const char *end = field->value.data() + field->value.size();
+        return from_chars(field->value.data(), end, out).ptr == end;
+    }
+};
+
+inline void appendJsonString(string &out, string_view text)
+{
+    out += '"';
+    for (char c : text)
+    {
+        switch (c)
+        {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        case '\r':
+            out += "\\r";
+            break;
+        case '\t':
+            out += "\\t";
+            break;
+        default:
+            if ((unsigned char)c < 0x20)
+            {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char)c);
+                out += escaped;
+            }
+            else
+                out += c;
+        }
+    }
+    out += '"';
+}
+
+// Builds one JSON object; values are appended in call order.
+class JsonWriter
+{
+    string &out;
+    bool first = true;
+
+    void key(string_view name)
+    {
+        out += first ? '{' : ',';
+        first = false;
+        appendJsonString(out, name);
+        out += ':';
+    }
+
+public:
+    explicit JsonWriter(string &out) : out(out) {}
+
+    JsonWriter &field(string_view name, string_view value)
+    {
+        key(name);
+        appendJsonString(out, value);
+        return *this;
+    }
+
+    JsonWriter &field(string_view name, const char *value)
+    {
+        return field(name, string_view(value));
+    }
+
+    JsonWriter &field(string_view name, long long value)
+    {
+        key(name);
+        out += to_string(value);
+        return *this;
+    }
+
+    JsonWriter &field(string_view name, bool value)
+    {
+        key(name);
+        out += value ? "true" : "false";
+        return *this;
+    }
+
+    JsonWriter &raw(string_view name, string_view json)
+    {
+        key(name);
+        out += json;
+        return *this;
+    }
+
+    void end()
+    {
+        out += first ? "{}" : "}";
+        out += '\n';
+    }
+};
+
+// Executes JSON-lines commands against the system state, a chunk at a time
+// whose logged changes are committed together before its results return:
+//
+//   {"op":"register","name":..,"license":..,"aadhar":..,"mobile":..}
+//   {"op":"login","name":..,"license":..}
+//   {"op":"book","carId":7,"customer":..,"type":"day"|"hour","duration":2}
+//   {"op":"return","carId":7}
+//   {"op":"quote","carId":7,"type":"day"|"hour","duration":2}
+//   {"op":"available","category":"SUV"} with an optional "branch" to
+//       count free and total cars of the category
+//   {"op":"add-edge","from":..,"to":..,"distance":12}
+//   {"op":"route","from":..,"to":..}
+//   {"op":"enqueue","customer":..} or with "category", "hours",
+//       "priority" (1-3) and "timeoutMinutes" to join a car waitlist
+//
+// Every command may carry an "id" that is echoed back. A chunk's commands
+// are grouped by type and run in phases: registrations, logins, road edits,
+// bookings, returns and waitlist entries (in input order), quotes, then
+// routes, so edits land before the queries that need them and each group
+// runs in a tight loop. Results come out one line per command in input
+// order.
+class CommandProcessor
+{
+    enum Phase
+    {
+        RegisterPhase,
+        LoginPhase,
+        EdgePhase,
+        RentalPhase,
+        QuotePhase,
+        RoutePhase,
+        phaseCount
+    };
+
+    SystemState &state;
+    shared_mutex *sharedState;
+    vector<JsonFields> commands;
+    vector<string> results;
+    vector<size_t> byPhase[phaseCount];
+    vector<string> path;
+    string text, other;
+
+    static bool phaseOf(const string &op, Phase &phase)
+    {
+        static const pair<const char *, Phase> phases[] = {
+            {"register", RegisterPhase}, {"login", LoginPhase}, {"add-edge", EdgePhase}, {"book", RentalPhase}, {"return", RentalPhase},
+            {"enqueue", RentalPhase}, {"quote", QuotePhase}, {"available", QuotePhase},
+            {"route", RoutePhase}};
+        for (const auto &entry : phases)
+        {
+            if (op == entry.first)
+            {
+                phase = entry.second;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    JsonWriter begin(size_t index, const string &op)
+    {
+        results[index].clear();
+        JsonWriter writer(results[index]);
+        long long id;
+        if (commands[index].getInt("id", id))
+            writer.field("id", id);
+        else if (commands[index].getString("id", text))
+            writer.field("id", text);
+        if (!op.empty())
+            writer.field("op", op);
+        return writer;
+    }
+
+    void fail(size_t index, const string &op, const char *error)
+    {
+        begin(index, op).field("ok", false).field("error", error).end();
+    }
+
+    bool rentalArguments(const JsonFields &command, long long &carId, RateType &type, long long &duration)
+    {
+        return command.getInt("carId", carId) && command.getString("type", text) && parseRateType(text, type) &&
+               command.getInt("duration", duration) && duration > 0 && carId >= INT_MIN && carId <= INT_MAX;
+    }
+
+    void enqueue(size_t index, const string &op)
+    {
+        const JsonFields &command = commands[index];
+        if (!command.getString("customer", other))
+            return fail(index, op, "customer is required");
+        if (!command.getString("category", text))
+        {
+            OperationTimer timer(Metric::Waitlist);
+            if (!state.waitlist.enqueue(other))
+                return fail(index, op, "waitlist is full");
+            begin(index, op).field("ok", true).end();
+            return;
+        }
+        long long hours = 1, priority = 2, timeout = 0;
+        command.getInt("hours", hours);
+        command.getInt("priority", priority);
+        command.getInt("timeoutMinutes", timeout);
+        CarCategory category;
+        if (!parseCategory(text, category) || hours <= 0 || priority < 1 || priority > 3 || timeout < 0)
+            return fail(index, op, "unknown category or invalid hours, priority or timeout");
+        WaitlistResult result = state.rentals.joinWaitlist(text, other, (int)priority - 1, hours, chrono::minutes(timeout));
+        JsonWriter writer = begin(index, op);
+        writer.field("ok", true);
+        if (result.bookedCar)
+            writer.field("bookedCarId", (long long)result.bookedCar->id());
+        else
+            writer.field("waiting", (long long)result.waiting);
+        writer.end();
+    }
+
+    void execute(size_t index, Phase phase, const string &op)
+    {
+        const JsonFields &command = commands[index];
+        CarRentalSystem &rentals = state.rentals;
+        long long carId, duration, number;
+        RateType type;
+        switch (phase)
+        {
+        case RegisterPhase:
+        {
+            string license, aadhar, mobile;
+            if (!command.getString("name", text) || !command.getString("license", license) ||
+                !command.getString("aadhar", aadhar) || !command.getString("mobile", mobile))
+                return fail(index, op, "name, license, aadhar and mobile are required");
+            RegistrationResult result = rentals.registerCustomer(Customer(text, license, aadhar, mobile));
+            if (result.conflict != CustomerKey::Count)
+            {
+                static const char *const taken[] = {"license already registered", "Aadhar already registered",
+                                                    "mobile number already registered"};
+                return fail(index, op, taken[(int)result.conflict]);
+            }
+            if (!result.ok)
+                return fail(index, op, "could not log the registration");
+            begin(index, op).field("ok", true).field("saved", result.saved).end();
+            return;
+        }
+        case LoginPhase:
+        {
+            string license;
+            if (!command.getString("name", text) || !command.getString("license", license))
+                return fail(index, op, "name and license are required");
+            if (!rentals.tryLoginCustomer(text, license))
+                return fail(index, op, "customer not found");
+            begin(index, op).field("ok", true).end();
+            return;
+        }
+        case EdgePhase:
+            if (!command.getString("from", text) || !command.getString("to", other) ||
+                !command.getInt("distance", number) || number < 0 || number > INT_MAX)
+                return fail(index, op, "from, to and a non-negative distance are required");
+            if (!state.rentalLocations.addEdge(text, other, (int)number))
+                return fail(index, op, "could not log the road");
+            if (sharedState)
+                state.rentalLocations.prepareQueries();
+            begin(index, op).field("ok", true).end();
+            return;
+        case RentalPhase:
+            if (op == "enqueue")
+                return enqueue(index, op);
+            if (op == "return")
+            {
+                if (!command.getInt("carId", carId) || carId < INT_MIN || carId > INT_MAX)
+                    return fail(index, op, "carId is required");
+                ReturnResult result = rentals.returnCar((int)carId);
+                JsonWriter writer = begin(index, op);
+                writer.field("ok", result.ok);
+                if (!result.ok)
+                    writer.field("error", "unknown car or car not out");
+                else if (!result.dispatchedTo.empty())
+                    writer.field("dispatchedTo", result.dispatchedTo);
+                writer.end();
+                return;
+            }
+            if (!command.getString("customer", other) || !rentalArguments(command, carId, type, duration))
+                return fail(index, op, "customer, carId, type (day/hour) and a positive duration are required");
+            {
+                RentalResult result = rentals.bookCar((int)carId, other, type, duration);
+                JsonWriter writer = begin(index, op);
+                writer.field("ok", result.ok);
+                if (result.ok)
+                    writer.field("start", result.start).field("end", result.end).field("price", (long long)result.price);
+                else
+                    writer.field("error", result.car ? "car not available for that period" : "unknown car");
+                writer.end();
+            }
+            return;
+        case QuotePhase:
+        {
+            if (op == "available")
+            {
+                CarCategory category;
+                number = FleetStore::anyBranch;
+                if (!command.getString("category", text) || !parseCategory(text, category))
+                    return fail(index, op, "a known category is required");
+                if (command.has("branch") &&
+                    (!command.getInt("branch", number) || number < 0 || number >= FleetStore::maxBranches))
+                    return fail(index, op, "branch must be a number below 65535");
+                begin(index, op)
+                    .field("ok", true)
+                    .field("available", (long long)rentals.countAvailable(text, (int)number))
+                    .field("total", (long long)rentals.countCars(text.c_str(), (int)number))
+                    .end();
+                return;
+            }
+            if (!rentalArguments(command, carId, type, duration))
+                return fail(index, op, "carId, type (day/hour) and a positive duration are required");
+            Money price = rentals.priceRental((int)carId, type, duration);
+            if (price < 0)
+                return fail(index, op, rentals.findCar((int)carId) ? "period beyond the rate calendar" : "unknown car");
+            begin(index, op).field("ok", true).field("price", (long long)price).field("display", formatMoney(price)).end();
+            return;
+        }
+        case RoutePhase:
+        {
+            if (!command.getString("from", text) || !command.getString("to", other))
+                return fail(index, op, "from and to are required");
+            int distance = state.rentalLocations.route(text, other, path);
+            if (distance < 0)
+                return fail(index, op, "no route");
+            string stops = "[";
+            for (size_t i = 0; i < path.size(); i++)
+            {
+                if (i)
+                    stops += ',';
+                appendJsonString(stops, path[i]);
+            }
+            stops += ']';
+            begin(index, op).field("ok", true).field("distance", (long long)distance).raw("path", stops).end();
+            return;
+        }
+        default:
+            return;
+        }
+    }
+
+    // Logins, bookings, returns, waitlist entries, quotes and routes only
+    // read shared state (bookings go through the fleet's own locks, entries
+    // through the lock-free waitlist and the dispatcher's lock); the rest
+    // need it alone.
+    static bool readsOnly(Phase phase)
+    {
+        return phase == LoginPhase || phase == RentalPhase || phase == QuotePhase || phase == RoutePhase;
+    }
+
+    // Runs one command and tells whether it appended to the log.
+    bool executeLogged(size_t index, Phase phase, const string &op)
+    {
+        uint64_t before = WriteAheadLog::lastAppendedByThread();
+        execute(index, phase, op);
+        return WriteAheadLog::lastAppendedByThread() != before;
+    }
+
+    // The log could not be committed, so the commands that appended to it
+    // have been undone; their results become errors rather than a false
+    // "ok". Commands that failed validation or only queued keep theirs.
+    void failUndurable(const vector<bool> &logged, const vector<string> &ops)
+    {
+        for (size_t i = 0; i < logged.size(); i++)
+        {
+            if (logged[i])
+                fail(i, ops[i], "change could not be made durable");
+        }
+    }
+
+    bool prepare(size_t index, string_view line, string &op, Phase &phase)
+    {
+        op.clear();
+        if (!commands[index].parse(line))
+        {
+            commands[index].parse("{}");
+            fail(index, op, "malformed JSON object");
+            return false;
+        }
+        if (!commands[index].getString("op", op) || !phaseOf(op, phase))
+        {
+            fail(index, op, "unknown op");
+            return false;
+        }
+        return true;
+    }
+
+public:
+    // When sharedState is given, several processors may run on the same
+    // state from different threads through runEach.
+    explicit CommandProcessor(SystemState &state, shared_mutex *sharedState = nullptr)
+        : state(state), sharedState(sharedState) {}
+
+    // Runs commands one at a time in input order, each under the shared
+    // state lock it needs, and commits their log records together; replies[i]
+    // gets the result line of lines[i] without its newline.
+    void runEach(const vector<string_view> &lines, vector<string> &replies)
+    {
+        if (commands.size() < lines.size())
+            commands.resize(lines.size());
+        results.resize(lines.size());
+        vector<string> ops(lines.size());
+        vector<bool> logged(lines.size(), false);
+        {
+            WriteAheadLog::DeferredCommit commitOnce(state.log);
+            for (size_t i = 0; i < lines.size(); i++)
+            {
+                Phase phase;
+                if (!prepare(i, lines[i], ops[i], phase))
+                    continue;
+                if (!sharedState)
+                    logged[i] = executeLogged(i, phase, ops[i]);
+                else if (readsOnly(phase))
+                {
+                    shared_lock<shared_mutex> lock(*sharedState);
+                    logged[i] = executeLogged(i, phase, ops[i]);
+                }
+                else
+                {
+                    unique_lock<shared_mutex> lock(*sharedState);
+                    logged[i] = executeLogged(i, phase, ops[i]);
+                }
+            }
+            bool durable = commitOnce.finish();
+            if (sharedState && WriteAheadLog::hasUnsettled())
+            {
+                // Undos and follow-ups touch the customer index, the graph
+                // and customers.txt, which other processors read.
+                unique_lock<shared_mutex> lock(*sharedState);
+                commitOnce.settle();
+                if (!durable)
+                    state.rentalLocations.prepareQueries();
+            }
+            commitOnce.settle();
+            if (!durable)
+                failUndurable(logged, ops);
+        }
+        replies.resize(lines.size());
+        for (size_t i = 0; i < lines.size(); i++)
+        {
+            replies[i] = move(results[i]);
+            if (!replies[i].empty() && replies[i].back() == '\n')
+                replies[i].pop_back();
+        }
+    }
+
+    // Runs one chunk of command lines and appends one result line per
+    // command to out. Blank lines are skipped.
+    void run(const vector<string_view> &lines, string &out)
+    {
+        if (commands.size() < lines.size())
+            commands.resize(lines.size());
+        results.resize(lines.size());
+        for (vector<size_t> &group : byPhase)
+            group.clear();
+
+        vector<string> ops(lines.size());
+        vector<bool> skipped(lines.size(), false);
+        for (size_t i = 0; i < lines.size(); i++)
+        {
+            string_view line = lines[i];
+            while (!line.empty() && (line.back() == '\r' || line.back() == ' '))
+                line.remove_suffix(1);
+            if (line.empty())
+            {
+                skipped[i] = true;
+                continue;
+            }
+            Phase phase;
+            if (prepare(i, line, ops[i], phase))
+                byPhase[phase].push_back(i);
+        }
+
+        {
+            WriteAheadLog::DeferredCommit commitOnce(state.log);
+            vector<bool> logged(lines.size(), false);
+            for (int phase = 0; phase < phaseCount; phase++)
+            {
+                for (size_t index : byPhase[phase])
+                    logged[index] = executeLogged(index, (Phase)phase, ops[index]);
+            }
+            bool durable = commitOnce.finish();
+            commitOnce.settle();
+            if (!durable)
+                failUndurable(logged, ops);
+        }
+        for (size_t i = 0; i < lines.size(); i++)
+        {
+            if (!skipped[i])
+                out += results[i];
+        }
+    }
+};
+
+// Batch mode: reads JSON-lines commands from in 4 MiB at a time, runs the
+// complete lines of each read in chunks of up to chunkLines commands and
+// writes the results to out, compacting the log between chunks. Returns the
+// number of commands run.
+size_t runBatch(istream &in, ostream &out, SystemState &state, size_t chunkLines = 65536)
+{
+    CommandProcessor processor(state);
+    vector<char> buffer(4 << 20);
+    string pending, results;
+    vector<string_view> lines;
+    size_t processed = 0;
+
+    auto runLines = [&]()
+    {
+        processor.run(lines, results);
+        compactLogIfNeeded(state);
+        out.write(results.data(), results.size());
+        processed += lines.size();
+        results.clear();
+        lines.clear();
+    };
+
+    while (in)
+    {
+        in.read(buffer.data(), buffer.size());
+        pending.append(buffer.data(), (size_t)in.gcount());
+        size_t start = 0;
+        for (size_t newline; (newline = pending.find('\n', start)) != string::npos; start = newline + 1)
+        {
+            lines.emplace_back(pending.data() + start, newline - start);
+            if (lines.size() == chunkLines)
+                runLines();
+        }
+        if (!lines.empty())
+            runLines();
+        pending.erase(0, start);
+    }
+    if (!pending.empty())
+    {
+        lines.emplace_back(pending);
+        runLines();
+    }
+    out.flush();
+    return processed;
+}
+
+// std::queue behind a mutex: the baseline the lock-free waitlist is
+// measured against.
+class LockedWaitlist
+{
+    mutex lock;
+    queue<string> customerQueue;
+
+public:
+    bool enqueue(const string &customer)
+    {
+        lock_guard<mutex> guard(lock);
+        customerQueue.push(customer);
+        return true;
+    }
+
+    size_t dequeueBatch(vector<string> &out, size_t maxCount)
+    {
+        lock_guard<mutex> guard(lock);
+        size_t taken = 0;
+        while (taken < maxCount && !customerQueue.empty())
+        {
+            out.push_back(move(customerQueue.front()));
+            customerQueue.pop();
+            taken++;
+        }
+        return taken;
+    }
+};
+
+// `producers` threads each enqueue `perProducer` customers while one
+// dispatcher thread drains the waitlist in batches. Returns items per second.
+template <typename Queue>
+double waitlistThroughput(Queue &waitlist, unsigned producers, size_t perProducer)
+{
+    size_t total = producers * perProducer;
+    auto started = chrono::steady_clock::now();
+    vector<thread> threads;
+    for (unsigned p = 0; p < producers; p++)
+    {
+        threads.emplace_back([&waitlist, p, perProducer]()
+        {
+            for (size_t i = 0; i < perProducer; i++)
+            {
+                string customer = "C" + to_string(p) + "-" + to_string(i);
+                while (!waitlist.enqueue(customer))
+                    this_thread::yield();
+            }
+        });
+    }
+
+    vector<string> batch;
+    size_t served = 0;
+    while (served < total)
+    {
+        batch.clear();
+        size_t taken = waitlist.dequeueBatch(batch, 64);
+        if (taken == 0)
+            this_thread::yield();
+        served += taken;
+    }
+    for (thread &producer : threads)
+        producer.join();
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    return total / seconds;
+}
+
+void benchmarkWaitlists()
+{
+    const size_t perProducer = 200000;
+    cout << "Producers | lock-free ops/s | mutex+queue ops/s\n";
+    for (unsigned producers : {1u, 2u, 4u, 8u, 16u})
+    {
+        ConcurrentWaitlist lockFree(4096);
+        LockedWaitlist locked;
+        double lockFreeRate = waitlistThroughput(lockFree, producers, perProducer / producers);
+        double lockedRate = waitlistThroughput(locked, producers, perProducer / producers);
+        cout << setw(9) << producers << " | " << setw(15) << (long long)lockFreeRate << " | "
+             << setw(17) << (long long)lockedRate << "\n";
+    }
+}
+
+// Many threads book and return random cars, half of the attempts aimed at
+// a small hot set. Every successful booking records its owner in a shadow
+// table; finding another owner there means a car was booked twice.
+void benchmarkBooking()
+{
+    const int fleetSize = 100000;
+    const int firstId = 1000000;
+    const size_t totalOperations = 4000000;
+
+    cout << "Threads | ops/s       | bookings  | double bookings\n";
+    for (unsigned threadCount : {1u, 8u, 64u})
+    {
+        CarRentalSystem system;
+        for (int i = 0; i < fleetSize; i++)
+            system.addCar(Car(firstId + i, i % 3 == 0 ? "SUV" : (i % 3 == 1 ? "Sedan" : "Hatchback"), "Car " + to_string(i)));
+        vector<atomic<int>> owner(fleetSize);
+        for (atomic<int> &slot : owner)
+            slot.store(-1);
+        atomic<long long> bookings(0), doubleBookings(0);
+
+        auto started = chrono::steady_clock::now();
+        vector<thread> threads;
+        for (unsigned t = 0; t < threadCount; t++)
+        {
+            threads.emplace_back([&, t]()
+            {
+                uint64_t state = 0x9e3779b97f4a7c15ULL * (t + 1);
+                auto nextRandom = [&state]()
+                {
+                    state ^= state << 13;
+                    state ^= state >> 7;
+                    state ^= state << 17;
+                    return state;
+                };
+                vector<int> held;
+                for (size_t op = 0; op < totalOperations / threadCount; op++)
+                {
+                    uint64_t r = nextRandom();
+                    if (held.size() < 8 && (r & 1))
+                    {
+                        int index = (r & 2) ? (int)((r >> 8) % 256) : (int)((r >> 8) % fleetSize);
+                        if (!system.tryBookCar(firstId + index, "bench", 1))
+                            continue;
+                        bookings++;
+                        if (owner[index].exchange((int)t) != -1)
+                            doubleBookings++;
+                        held.push_back(index);
+                    }
+                    else if (!held.empty())
+                    {
+                        int index = held.back();
+                        held.pop_back();
+                        owner[index].store(-1);
+                        if (!system.tryReturnCar(firstId + index))
+                            doubleBookings++;
+                    }
+                }
+            });
+        }
+        for (thread &worker : threads)
+            worker.join();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+        cout << setw(7) << threadCount << " | " << setw(11) << (long long)(totalOperations / seconds) << " | "
+             << setw(9) << bookings.load() << " | " << doubleBookings.load() << "\n";
+    }
+}
+
+// Deterministic xorshift generator for the synthetic benchmark data.
+struct BenchRandom
+{
+    uint64_t state;
+
+    explicit BenchRandom(uint64_t seed) : state(seed * 0x9e3779b97f4a7c15ULL + 1) {}
+
+    uint64_t next()
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+    size_t below(size_t bound)
+    {
+        return (size_t)(next() % bound);
+    }
+};
+
+const int benchFirstCarId = 1000000;
+const int benchBranches = 64;
+
+vector<Car> generateFleet(size_t count)
+{
+    vector<Car> fleet;
+    fleet.reserve(count);
+    for (size_t i = 0; i < count; i++)
+        fleet.push_back(Car(benchFirstCarId + (int)i, categoryName((CarCategory)(i % categoryCount)), "Car " + to_string(i),
+                            (int)(i / 7 % benchBranches)));
+    return fleet;
+}
+
+// Lines in customers.txt format; customer i logs in as CUSTi / Li.
+void generateCustomerFile(const string &path, size_t count)
+{
+    ofstream out(path, ios::binary | ios::trunc);
+    string line;
+    for (size_t i = 0; i < count; i++)
+    {
+        line = "CUST" + to_string(i) + ",L" + to_string(i) + "," + to_string(100000000000ULL + i) + "," +
+               to_string(9000000000ULL + i) + "\n";
+        out << line;
+    }
+}
+
+// A square grid of locations L0..Ln-1 with random road lengths, so every
+// pair is connected and paths run across the whole network.
+void generateRoadNetwork(Graph &graph, size_t nodes, BenchRandom &random)
+{
+    size_t side = max<size_t>(1, (size_t)sqrt((double)nodes));
+    for (size_t i = 0; i < nodes; i++)
+    {
+        string name = "L" + to_string(i);
+        if ((i + 1) % side != 0 && i + 1 < nodes)
+            graph.addEdge(name, "L" + to_string(i + 1), 1 + (int)random.below(100));
+        if (i + side < nodes)
+            graph.addEdge(name, "L" + to_string(i + side), 1 + (int)random.below(100));
+    }
+}
+
+// (car id, hours) requests; half of them aim at a hot set of 256 cars.
+vector<pair<int, int>> generateBookingStream(size_t count, size_t fleetSize, BenchRandom &random)
+{
+    vector<pair<int, int>> stream(count);
+    for (auto &request : stream)
+    {
+        uint64_t r = random.next();
+        size_t index = (r & 1) ? (size_t)((r >> 8) % min<size_t>(256, fleetSize)) : (size_t)((r >> 8) % fleetSize);
+        request = {benchFirstCarId + (int)index, 1 + (int)((r >> 40) % 72)};
+    }
+    return stream;
+}
+
+template <typename Fn>
+double secondsFor(Fn fn)
+{
+    auto started = chrono::steady_clock::now();
+    fn();
+    return chrono::duration<double>(chrono::steady_clock::now() - started).count();
+}
+
+// One JSON object per line, so results can be diffed or loaded by scripts.
+void reportBenchmark(const string &name, size_t scale, size_t operations, double seconds)
+{
+    cout << "{\"benchmark\":\"" << name << "\",\"scale\":" << scale << ",\"operations\":" << operations
+         << ",\"seconds\":" << fixed << setprecision(6) << seconds << ",\"nsPerOp\":" << setprecision(1)
+         << seconds * 1e9 / max<size_t>(1, operations) << "}" << defaultfloat << setprecision(6) << endl;
+}
+
+// Every core structure at 10^3 .. 10^maxExponent elements. Graph queries and
+// journal writes are capped per scale so large runs stay bounded; the
+// contraction hierarchy, whose preprocessing grows fastest, is skipped
+// above 10^5 locations.
+void benchmarkCore(int maxExponent)
+{
+    const string journalPath = "bench_bookings.log";
+    const string customerPath = "bench_customers.txt";
+    size_t scale = 1000;
+    for (int exponent = 3; exponent <= maxExponent; exponent++, scale *= 10)
+    {
+        BenchRandom random(exponent);
+
+        {
+            VehicleTree tree;
+            vector<int> ids(scale);
+            for (size_t i = 0; i < scale; i++)
+                ids[i] = (int)i;
+            for (size_t i = scale; i > 1; i--)
+                swap(ids[i - 1], ids[random.below(i)]);
+            reportBenchmark("vehicleTree.addVehicle", scale, scale, secondsFor([&]()
+            {
+                for (int id : ids)
+                    tree.addVehicle(id, "Vehicle");
+            }));
+            size_t found = 0;
+            reportBenchmark("vehicleTree.findVehicle", scale, scale, secondsFor([&]()
+            {
+                for (size_t i = 0; i < scale; i++)
+                    found += tree.findVehicle((int)random.below(scale * 2)) != nullptr;
+            }));
+        }
+
+        {
+            remove(journalPath.c_str());
+            BookingHistory history(journalPath);
+            size_t writes = min<size_t>(scale, 100000);
+            reportBenchmark("bookingHistory.addBooking", scale, writes, secondsFor([&]()
+            {
+                for (size_t i = 0; i < writes; i++)
+                    history.addBooking("Booking " + to_string(i) + " for CUST" + to_string(i % scale));
+            }));
+        }
+        remove(journalPath.c_str());
+
+        {
+            generateCustomerFile(customerPath, scale);
+            CustomerIndex index;
+            reportBenchmark("customerIndex.load", scale, scale, secondsFor([&]()
+            {
+                index.load(customerPath);
+            }));
+            size_t hits = 0;
+            reportBenchmark("customerIndex.find", scale, scale, secondsFor([&]()
+            {
+                for (size_t i = 0; i < scale; i++)
+                {
+                    size_t customer = random.below(scale * 2);
+                    hits += index.find("CUST" + to_string(customer), "L" + to_string(customer)) != nullptr;
+                }
+            }));
+        }
+        remove(customerPath.c_str());
+
+        {
+            Graph graph;
+            generateRoadNetwork(graph, scale, random);
+            size_t queries = max<size_t>(1, min<size_t>(200, 10000000 / scale));
+            vector<pair<string, string>> pairs(queries);
+            for (auto &query : pairs)
+                query = {"L" + to_string(random.below(scale)), "L" + to_string(random.below(scale))};
+            long long total = 0;
+            vector<int> expected(queries), found(queries);
+            reportBenchmark("graph.shortestPath.dijkstra", scale, queries, secondsFor([&]()
+            {
+                for (size_t i = 0; i < queries; i++)
+                    expected[i] = graph.shortestPath(pairs[i].first, pairs[i].second);
+            }));
+            graph.setShortestPathEngine(ShortestPathEngine::DeltaStepping);
+            reportBenchmark("graph.shortestPath.deltaStepping", scale, queries, secondsFor([&]()
+            {
+                for (size_t i = 0; i < queries; i++)
+                    found[i] = graph.shortestPath(pairs[i].first, pairs[i].second);
+            }));
+            graph.setShortestPathEngine(ShortestPathEngine::Dijkstra);
+            if (found != expected)
+                cout << "graph.shortestPath.deltaStepping disagrees with Dijkstra at scale " << scale << "\n";
+
+            size_t side = scale <= 100000 ? 16 : 4;
+            vector<string> sources(side), targets(side);
+            for (size_t i = 0; i < side; i++)
+            {
+                sources[i] = "L" + to_string(random.below(scale));
+                targets[i] = "L" + to_string(random.below(scale));
+            }
+            vector<int> pairwise;
+            for (const string &source : sources)
+                for (const string &target : targets)
+                    pairwise.push_back(graph.shortestPath(source, target));
+            DistanceMatrix table;
+            auto checkTable = [&](const char *engine)
+            {
+                vector<int> firstRow(pairwise.begin(), pairwise.begin() + side);
+                if (table.values != pairwise || graph.distancesFrom(sources[0], targets) != firstRow)
+                    cout << "graph.distanceTable." << engine << " disagrees with shortestPath at scale " << scale << "\n";
+            };
+            reportBenchmark("graph.distanceTable.dijkstra", scale, side * side, secondsFor([&]()
+            {
+                table = graph.distanceTable(sources, targets);
+            }));
+            checkTable("dijkstra");
+            if (scale <= 100000)
+            {
+                graph.enableContractionHierarchy(true);
+                reportBenchmark("graph.contractionHierarchy.build", scale, 1, secondsFor([&]()
+                {
+                    total += graph.shortestPath(pairs[0].first, pairs[0].second);
+                }));
+                reportBenchmark("graph.shortestPath.hierarchy", scale, queries, secondsFor([&]()
+                {
+                    for (const auto &query : pairs)
+                        total += graph.shortestPath(query.first, query.second);
+                }));
+                reportBenchmark("graph.distanceTable.hierarchy", scale, side * side, secondsFor([&]()
+                {
+                    table = graph.distanceTable(sources, targets);
+                }));
+                checkTable("hierarchy");
+            }
+        }
+
+        {
+            CarRentalSystem rentals(false);
+            vector<Car> fleet = generateFleet(scale);
+            reportBenchmark("rentals.addCar", scale, scale, secondsFor([&]()
+            {
+                for (const Car &car : fleet)
+                    rentals.addCar(car);
+            }));
+
+            vector<pair<int, int>> stream = generateBookingStream(scale, scale, random);
+            reportBenchmark("rentals.bookAndReturn", scale, stream.size() * 2, secondsFor([&]()
+            {
+                for (const auto &request : stream)
+                {
+                    if (rentals.tryBookCar(request.first, "bench", request.second))
+                        rentals.tryReturnCar(request.first);
+                }
+            }));
+
+            long long now = currentHour();
+            for (size_t i = 0; i < scale; i += 2)
+                rentals.tryReserveCar(fleet[i].id, "bench", now + 24 + (long long)(i % 48), now + 48 + (long long)(i % 48));
+            size_t scans = max<size_t>(1, min<size_t>(1000, 100000000 / scale));
+            size_t free = 0;
+            reportBenchmark("rentals.findFreeCars", scale, scans, secondsFor([&]()
+            {
+                for (size_t i = 0; i < scans; i++)
+                {
+                    long long start = now + (long long)random.below(96);
+                    free += rentals.findFreeCars(categoryName((CarCategory)(i % categoryCount)), start, start + 12).size();
+                }
+            }));
+            scans = max<size_t>(1, min<size_t>(100000, 1000000000 / scale));
+            vector<size_t> counts(scans);
+            reportBenchmark("rentals.countAvailableInBranch", scale, scans, secondsFor([&]()
+            {
+                for (size_t i = 0; i < scans; i++)
+                    counts[i] = rentals.countAvailable(categoryName((CarCategory)(i % categoryCount)), (int)(i % benchBranches));
+            }));
+            reportBenchmark("rentals.countCarsInBranch", scale, scans, secondsFor([&]()
+            {
+                for (size_t i = 0; i < scans; i++)
+                    counts[i] = rentals.countCars(categoryName((CarCategory)(i % categoryCount)), (int)(i % benchBranches));
+            }));
+
+            vector<QuoteRequest> quotes(scale);
+            for (QuoteRequest &quote : quotes)
+                quote = {benchFirstCarId + (int)random.below(scale), (RateType)random.below(rateTypeCount), (int64_t)random.below(500)};
+            vector<Money> prices(scale);
+            reportBenchmark("rentals.quoteBatch", scale, scale, secondsFor([&]()
+            {
+                rentals.quoteBatch(quotes.data(), quotes.size(), prices.data());
+            }));
+        }
+    }
+}
+
+// Checks the prefix-summed quote against the day-by-day reference on random
+// ranges over two years, so every season and weekend is crossed, including
+// ranges that run past the calendar, then times both. Returns false on any
+// mismatch.
+bool benchmarkRates()
+{
+    struct Range
+    {
+        CarCategory category;
+        long long start, end;
+    };
+
+    const long long firstDay = currentHour() / 24 - 1;
+    const int dayCount = 2 * 366 + 1;
+    const size_t checks = 1000000;
+    RateCalendar rates = standardRateCalendar(firstDay, dayCount);
+    BenchRandom random(15);
+
+    vector<Range> ranges(checks);
+    for (Range &range : ranges)
+    {
+        range.category = (CarCategory)random.below(categoryCount);
+        range.start = firstDay * 24 - 48 + (long long)random.below((dayCount + 4) * 24);
+        range.end = range.start + (long long)(random.below(4) == 0 ? random.below(24) : random.below(90 * 24));
+    }
+
+    size_t mismatches = 0;
+    for (const Range &range : ranges)
+    {
+        Money fast = rates.quote(range.category, range.start, range.end);
+        Money reference = rates.quoteByDay(range.category, range.start, range.end);
+        if (fast != reference && mismatches++ < 10)
+            cout << "Mismatch for " << categoryName(range.category) << " hours [" << range.start << ", " << range.end
+                 << "): " << fast << " vs " << reference << "\n";
+    }
+
+    Money total = 0;
+    reportBenchmark("rates.quote", dayCount, checks, secondsFor([&]()
+    {
+        for (const Range &range : ranges)
+            total += rates.quote(range.category, range.start, range.end);
+    }));
+    reportBenchmark("rates.quoteByDay", dayCount, checks, secondsFor([&]()
+    {
+        for (const Range &range : ranges)
+            total += rates.quoteByDay(range.category, range.start, range.end);
+    }));
+    cout << "{\"check\":\"rates.quote\",\"ranges\":" << checks << ",\"mismatches\":" << mismatches
+         << ",\"total\":" << total << "}" << endl;
+    return mismatches == 0;
+}
+
+#ifdef __linux__
+// Server mode: an epoll loop on 127.0.0.1 speaking length-prefixed frames,
+// each a 4-byte big-endian payload length followed by one JSON command as
+// accepted by batch mode (book, return, quote, login, route, ...). Replies
+// use the same framing and come back in request order on each connection,
+// so clients may pipeline as many requests as they like. The I/O thread
+// only moves bytes; a fixed pool of workers runs the commands and hands the
+// replies back through an eventfd. Each connection is pinned to one worker,
+// so its requests also run in the order they were sent. A worker commits
+// the logged changes of each batch of jobs it takes with one sync.
+const uint32_t maxFrameBytes = 1 << 20;
+
+inline void appendFrame(string &out, string_view payload)
+{
+    uint32_t length = (uint32_t)payload.size();
+    char header[4] = {(char)(length >> 24), (char)(length >> 16), (char)(length >> 8), (char)length};
+    out.append(header, 4);
+    out.append(payload.data(), payload.size());
+}
+
+// Payload length of the frame at data, or -1 while its header is incomplete.
+inline long long frameLength(const char *data, size_t size)
+{
+    if (size < 4)
+        return -1;
+    const unsigned char *bytes = (const unsigned char *)data;
+    return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | bytes[3];
+}
+
+volatile sig_atomic_t serverStopRequested = 0;
+
+void requestServerStop(int)
+{
+    serverStopRequested = 1;
+}
+
+class RequestServer
+{
+    struct Job
+    {
+        uint64_t connection;
+        string payload;
+    };
+
+    struct WorkQueue
+    {
+        mutex lock;
+        condition_variable ready;
+        deque<Job> jobs;
+    };
+
+    struct Connection
+    {
+        int fd = -1;
+        string in, out;
+        size_t sent = 0;
+        uint64_t nextSequence = 0, nextReply = 0;
+        bool reading = true, writing = false, peerClosed = false;
+    };
+
+    static const uint64_t listenerTag = 0;
+    static const uint64_t wakeupTag = 1;
+    static const uint64_t maxInFlight = 4096;
+    static const size_t maxPendingOutput = 4 << 20;
+
+    SystemState &state;
+    shared_mutex stateLock;
+    int listener = -1, poller = -1, wakeup = -1;
+    unordered_map<uint64_t, Connection> connections;
+    uint64_t nextConnection = 2;
+
+    vector<unique_ptr<WorkQueue>> queues;
+    atomic<bool> stopping{false};
+    mutex repliesLock;
+    vector<Job> replies;
+    vector<thread> workers;
+
+    void work(WorkQueue &queue)
+    {
+        CommandProcessor processor(state, &stateLock);
+        vector<Job> batch;
+        vector<string_view> lines;
+        vector<string> results;
+        for (;;)
+        {
+            {
+                unique_lock<mutex> lock(queue.lock);
+                queue.ready.wait(lock, [&]()
+                                 { return stopping || !queue.jobs.empty(); });
+                if (queue.jobs.empty())
+                    return;
+                size_t take = min<size_t>(64, queue.jobs.size());
+                for (size_t i = 0; i < take; i++)
+                {
+                    batch.push_back(move(queue.jobs.front()));
+                    queue.jobs.pop_front();
+                }
+            }
+            for (Job &job : batch)
+                lines.emplace_back(job.payload);
+            processor.runEach(lines, results);
+            for (size_t i = 0; i < batch.size(); i++)
+                batch[i].payload = move(results[i]);
+            lines.clear();
+            bool wasEmpty;
+            {
+                lock_guard<mutex> lock(repliesLock);
+                wasEmpty = replies.empty();
+                for (Job &job : batch)
+                    replies.push_back(move(job));
+            }
+            batch.clear();
+            if (wasEmpty)
+            {
+                uint64_t one = 1;
+                ssize_t written = write(wakeup, &one, sizeof(one));
+                (void)written;
+            }
+        }
+    }
+
+    WorkQueue &queueOf(uint64_t connection)
+    {
+        return *queues[connection % queues.size()];
+    }
+
+    // Batches are queued in connection order, so each queue is locked once
+    // per run of jobs for it.
+    void submit(vector<Job> &batch)
+    {
+        for (size_t first = 0; first < batch.size();)
+        {
+            WorkQueue &queue = queueOf(batch[first].connection);
+            size_t last = first;
+            {
+                lock_guard<mutex> lock(queue.lock);
+                for (; last < batch.size() && &queueOf(batch[last].connection) == &queue; last++)
+                    queue.jobs.push_back(move(batch[last]));
+            }
+            queue.ready.notify_one();
+            first = last;
+        }
+        batch.clear();
+    }
+
+    void closeConnection(uint64_t id)
+    {
+        auto it = connections.find(id);
+        if (it == connections.end())
+            return;
+        epoll_ctl(poller, EPOLL_CTL_DEL, it->second.fd, nullptr);
+        close(it->second.fd);
+        connections.erase(it);
+    }
+
+    void acceptConnections()
+    {
+        for (;;)
+        {
+            int fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return;
+            }
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            uint64_t id = nextConnection++;
+            epoll_event event = {};
+            event.events = EPOLLIN;
+            event.data.u64 = id;
+            if (epoll_ctl(poller, EPOLL_CTL_ADD, fd, &event) < 0)
+            {
+                close(fd);
+                continue;
+            }
+            connections[id].fd = fd;
+        }
+    }
+
+    // Reads up to 1 MiB per wakeup so one busy client cannot starve the rest;
+    // the level-triggered poll comes back for whatever is left.
+    bool readAvailable(Connection &connection)
+    {
+        char buffer[64 * 1024];
+        for (size_t total = 0; total < (1 << 20);)
         {
-            cout << current->bookingDetails << endl;
-            current = current->next;
+            ssize_t received = recv(connection.fd, buffer, sizeof(buffer), 0);
+            if (received > 0)
+            {
+                connection.in.append(buffer, (size_t)received);
+                total += (size_t)received;
+            }
+            else if (received == 0)
+            {
+                connection.peerClosed = true;
+                return true;
+            }
+            else if (errno == EINTR)
+                continue;
+            else
+                return errno == EAGAIN || errno == EWOULDBLOCK;
         }
+        return true;
     }
 
-    ~BookingHistory()
+    // Queues every complete frame the in-flight limit allows; false if the
+    // client sent an oversized frame.
+    bool takeFrames(uint64_t id, Connection &connection, vector<Job> &batch)
     {
-        while (head)
+        size_t offset = 0;
+        while (connection.nextSequence - connection.nextReply < maxInFlight)
         {
-            Node *temp = head;
-            head = head->next;
-            delete temp;
+            long long length = frameLength(connection.in.data() + offset, connection.in.size() - offset);
+            if (length < 0)
+                break;
+            if (length > maxFrameBytes)
+                return false;
+            if (connection.in.size() - offset < 4 + (size_t)length)
+                break;
+            batch.push_back({id, connection.in.substr(offset + 4, (size_t)length)});
+            connection.nextSequence++;
+            offset += 4 + (size_t)length;
         }
+        connection.in.erase(0, offset);
+        return true;
     }
-};
 
-class VehicleTree
-{
-    struct TreeNode
-    {
-        int id;
-        string vehicleDetails;
-        TreeNode *left;
-        TreeNode *right;
-
-        TreeNode(int vehicleId, const string &details) : id(vehicleId), vehicleDetails(details), left(nullptr), right(nullptr) {}
-    };
-
-    TreeNode *root;
-
-    TreeNode *insert(TreeNode *node, int id, const string &details)
+    bool writePending(Connection &connection)
     {
-        if (!node)
-            return new TreeNode(id, details);
-        if (id < node->id)
-            node->left = insert(node->left, id, details);
-        else if (id > node->id)
-            node->right = insert(node->right, id, details);
-        return node;
+        while (connection.sent < connection.out.size())
+        {
+            ssize_t written = send(connection.fd, connection.out.data() + connection.sent,
+                                   connection.out.size() - connection.sent, MSG_NOSIGNAL);
+            if (written > 0)
+                connection.sent += (size_t)written;
+            else if (written < 0 && errno == EINTR)
+                continue;
+            else
+            {
+                if (connection.sent > (1 << 20))
+                {
+                    connection.out.erase(0, connection.sent);
+                    connection.sent = 0;
+                }
+                return written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+            }
+        }
+        connection.out.clear();
+        connection.sent = 0;
+        return true;
     }
 
-    void inOrder(TreeNode *node) const
+    // Re-arms the poll for what the connection can do next and closes it
+    // once the peer has hung up and every reply is out.
+    void settle(uint64_t id, Connection &connection)
     {
-        if (!node)
+        bool pending = connection.sent < connection.out.size();
+        if (connection.peerClosed && !pending && connection.nextReply == connection.nextSequence)
+            return closeConnection(id);
+        bool wantRead = !connection.peerClosed && connection.nextSequence - connection.nextReply < maxInFlight &&
+                        connection.out.size() - connection.sent < maxPendingOutput;
+        if (wantRead == connection.reading && pending == connection.writing)
             return;
-        inOrder(node->left);
-        cout << "ID: " << node->id << ", Details: " << node->vehicleDetails << endl;
-        inOrder(node->right);
-    }
-
-public:
-    VehicleTree() : root(nullptr) {}
-
-    void addVehicle(int id, const string &details)
-    {
-        root = insert(root, id, details);
+        epoll_event event = {};
+        event.events = (wantRead ? (uint32_t)EPOLLIN : 0u) | (pending ? (uint32_t)EPOLLOUT : 0u);
+        event.data.u64 = id;
+        epoll_ctl(poller, EPOLL_CTL_MOD, connection.fd, &event);
+        connection.reading = wantRead;
+        connection.writing = pending;
     }
 
-    void displayInventory() const
+    void deliverReplies(vector<Job> &batch)
     {
-        if (!root)
+        uint64_t count;
+        ssize_t drained = read(wakeup, &count, sizeof(count));
+        (void)drained;
+        vector<Job> finished;
         {
-            cout << "No vehicles in the inventory." << endl;
-            return;
+            lock_guard<mutex> lock(repliesLock);
+            finished.swap(replies);
+        }
+        // Each connection's replies arrive in request order from its worker.
+        vector<uint64_t> touched;
+        for (Job &reply : finished)
+        {
+            auto it = connections.find(reply.connection);
+            if (it == connections.end())
+                continue;
+            appendFrame(it->second.out, reply.payload);
+            it->second.nextReply++;
+            touched.push_back(reply.connection);
+        }
+        sort(touched.begin(), touched.end());
+        touched.erase(unique(touched.begin(), touched.end()), touched.end());
+        for (uint64_t id : touched)
+        {
+            Connection &connection = connections[id];
+            if (!writePending(connection) || !takeFrames(id, connection, batch))
+                closeConnection(id);
+            else
+                settle(id, connection);
         }
-        inOrder(root);
     }
-};
-
-class Car
-{
-public:
-    int id;
-    string category;
-    string name;
-    bool isAvailable;
 
-    Car(int id, string category, string name)
+    void serviceConnection(uint64_t id, uint32_t events, vector<Job> &batch)
     {
-        this->id = id;
-        this->category = category;
-        this->name = name;
-        this->isAvailable = true;
+        auto it = connections.find(id);
+        if (it == connections.end())
+            return;
+        Connection &connection = it->second;
+        if (events & EPOLLERR)
+            return closeConnection(id);
+        if ((events & (EPOLLIN | EPOLLHUP)) &&
+            (!readAvailable(connection) || !takeFrames(id, connection, batch)))
+            return closeConnection(id);
+        if ((events & EPOLLOUT) && !writePending(connection))
+            return closeConnection(id);
+        settle(id, connection);
     }
-};
 
-class Customer
-{
 public:
-    string name;
-    string license;
-    string aadhar;
-    string mobileNumber;
-
-    Customer(string name, string license, string aadhar, string mobileNumber)
-    {
-        this->name = name;
-        this->license = license;
-        this->aadhar = aadhar;
-        this->mobileNumber = mobileNumber;
-    }
-};
-struct RentalCompany
-{
-    string name;
-    string address;
-    string city;
-    string pincode;
-};
-
-void printNearbyRentalCompanies(string userCity, string pincode, vector<RentalCompany> &companies)
-{
-    cout << "\n--- Nearby Rental Companies ---\n";
-    bool foundNearby = false;
+    explicit RequestServer(SystemState &state) : state(state) {}
 
-    for (const auto &company : companies)
+    ~RequestServer()
     {
-        if (company.city == userCity && company.pincode == pincode)
+        stopping = true;
+        for (unique_ptr<WorkQueue> &queue : queues)
+        {
+            lock_guard<mutex> lock(queue->lock);
+            queue->ready.notify_all();
+        }
+        for (thread &worker : workers)
+            worker.join();
+        for (auto &entry : connections)
+            close(entry.second.fd);
+        for (int fd : {listener, poller, wakeup})
         {
-            foundNearby = true;
-            cout << "Company Name: " << company.name << endl;
-            cout << "Address: " << company.address << endl;
-            cout << "City: " << company.city << ", pincode: " << company.pincode << endl;
-            cout << "-------------------------------\n";
+            if (fd >= 0)
+                close(fd);
         }
     }
 
-    if (!foundNearby)
+    bool start(uint16_t port, unsigned workerCount)
     {
-        cout << "No rental companies found in your city and district.\n";
-    }
-}
+        listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        poller = epoll_create1(EPOLL_CLOEXEC);
+        wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (listener < 0 || poller < 0 || wakeup < 0)
+            return false;
+        int one = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(listener, (sockaddr *)&address, sizeof(address)) < 0 || listen(listener, SOMAXCONN) < 0)
+            return false;
 
-class CarRentalSystem
-{
-private:
-    vector<Car> cars;
-    vector<Customer> customers;
-
-public:
-    CarRentalSystem()
-    {
-        cars.push_back(Car(1, "SUV", "Toyota Fortuner"));
-        cars.push_back(Car(2, "Sedan", "Honda City"));
-        cars.push_back(Car(3, "Hatchback", "Maruti Swift"));
-        cars.push_back(Car(4, "SUV", "Hyundai Creta"));
-        cars.push_back(Car(5, "Sedan", "Tata Tiago"));
-        cars.push_back(Car(6, "Hatchback", "Hyundai i20"));
-        cars.push_back(Car(7, "SUV", "Mahindra Scorpio"));
-        cars.push_back(Car(8, "Sedan", "Maruti Suzuki Swift"));
-        cars.push_back(Car(9, "Hatchback", "Ford Figo"));
-        cars.push_back(Car(10, "SUV", "Tata Nexon"));
-        cars.push_back(Car(11, "Sedan", "Toyota Corolla"));
-        cars.push_back(Car(12, "SUV", "Mahindra Thar"));
-        cars.push_back(Car(13, "Hatchback", "Renault Kwid"));
-        cars.push_back(Car(14, "SUV", "Kia Seltos"));
-        cars.push_back(Car(15, "SUV", "Skoda Kushaq"));
-        cars.push_back(Car(16, "Sedan", "BMW 3 Series"));
-        cars.push_back(Car(17, "Hatchback", "Volkswagen Polo"));
-        cars.push_back(Car(18, "SUV", "Nissan X-Trail"));
-        cars.push_back(Car(19, "Sedan", "Audi A4"));
-        cars.push_back(Car(20, "SUV", "Jeep Compass"));
-        cars.push_back(Car(21, "SUV", "Ford Endeavour"));
-        cars.push_back(Car(22, "Sedan", "Mercedes-Benz C-Class"));
-        cars.push_back(Car(23, "Hatchback", "Suzuki Baleno"));
-        cars.push_back(Car(24, "SUV", "Land Rover Range Rover"));
-        cars.push_back(Car(25, "Sedan", "Hyundai Elantra"));
-        cars.push_back(Car(26, "Hatchback", "Honda Jazz"));
-        cars.push_back(Car(27, "SUV", "Volkswagen Tiguan"));
-        cars.push_back(Car(28, "Sedan", "Jaguar XF"));
-        cars.push_back(Car(29, "Hatchback", "Chevrolet Spark"));
-        cars.push_back(Car(30, "SUV", "BMW X5"));
-        cars.push_back(Car(31, "Sedan", "Audi Q5"));
-        cars.push_back(Car(32, "Hatchback", "Maruti Celerio"));
-        cars.push_back(Car(33, "SUV", "Toyota Land Cruiser"));
-        cars.push_back(Car(34, "Sedan", "Skoda Superb"));
-        cars.push_back(Car(35, "Hatchback", "Tata Altroz"));
-        cars.push_back(Car(36, "SUV", "Mahindra XUV300"));
-        cars.push_back(Car(37, "Sedan", "Honda Accord"));
-        cars.push_back(Car(38, "Hatchback", "Ford Fiesta"));
-        cars.push_back(Car(39, "SUV", "Jeep Wrangler"));
-        cars.push_back(Car(40, "Sedan", "Mercedes-Benz E-Class"));
-        cars.push_back(Car(41, "SUV", "Porsche Cayenne"));
-        cars.push_back(Car(42, "Hatchback", "Renault Triber"));
-        cars.push_back(Car(43, "Sedan", "Volvo S90"));
-        cars.push_back(Car(44, "SUV", "Tata Harrier"));
-        cars.push_back(Car(45, "Sedan", "Honda City ZX"));
-        cars.push_back(Car(46, "SUV", "Hyundai Tucson"));
-        cars.push_back(Car(47, "Hatchback", "Nissan Micra"));
-        cars.push_back(Car(48, "SUV", "Audi Q7"));
-        cars.push_back(Car(49, "Sedan", "BMW 5 Series"));
-        cars.push_back(Car(50, "SUV", "Kia Sonet"));
-        cars.push_back(Car(51, "Sedan", "Chevrolet Cruze"));
-        cars.push_back(Car(52, "Hatchback", "Datsun Redi-Go"));
-        cars.push_back(Car(53, "SUV", "Renault Duster"));
-        cars.push_back(Car(54, "Sedan", "Toyota Camry"));
-        cars.push_back(Car(55, "SUV", "Nissan Patrol"));
-        cars.push_back(Car(56, "Hatchback", "Suzuki Wagon R"));
-        cars.push_back(Car(57, "SUV", "MG Hector"));
-        cars.push_back(Car(58, "Sedan", "Lexus ES"));
-        cars.push_back(Car(59, "SUV", "Honda CR-V"));
-        cars.push_back(Car(60, "Hatchback", "Tata Nano"));
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.u64 = listenerTag;
+        epoll_ctl(poller, EPOLL_CTL_ADD, listener, &event);
+        event.data.u64 = wakeupTag;
+        epoll_ctl(poller, EPOLL_CTL_ADD, wakeup, &event);
+
+        // Queries after this point only read the graph.
+        state.rentalLocations.prepareQueries();
+        for (unsigned i = 0; i < max(1u, workerCount); i++)
+            queues.emplace_back(new WorkQueue);
+        for (unique_ptr<WorkQueue> &queue : queues)
+            workers.emplace_back(&RequestServer::work, this, ref(*queue));
+        return true;
     }
 
-    void calculateRentalPrice(int carId, string rentalType, int hoursOrDays)
+    // Serves until SIGINT or SIGTERM.
+    void run()
     {
-        for (Car &car : cars)
+        epoll_event events[256];
+        vector<Job> batch;
+        auto nextLogRepair = chrono::steady_clock::now();
+        while (!serverStopRequested)
         {
-            if (car.id == carId)
+            int count = epoll_wait(poller, events, 256, 200);
+            if (count < 0 && errno != EINTR)
+                break;
+            for (int i = 0; i < count; i++)
             {
-                int price = 0;
-
-                if (car.category == "SUV")
-                {
-                    if (rentalType == "day")
-                    {
-                        price = 10000 * hoursOrDays;
-                    }
-                    else if (rentalType == "hour")
-                    {
-                        price = 500 * hoursOrDays;
-                    }
-                }
-
-                else if (car.category == "Sedan")
-                {
-                    if (rentalType == "day")
-                    {
-                        price = 5000 * hoursOrDays;
-                    }
-                    else if (rentalType == "hour")
-                    {
-                        price = 300 * hoursOrDays;
-                    }
-                }
-
-                else if (car.category == "Hatchback")
-                {
-                    if (rentalType == "day")
-                    {
-                        price = 4000 * hoursOrDays;
-                    }
-                    else if (rentalType == "hour")
-                    {
-                        price = 250 * hoursOrDays;
-                    }
-                }
-
-                cout << "Car Name: " << car.name << endl;
-                cout << "Category: " << car.category << endl;
-                cout << "Rental Type: " << rentalType << endl;
-                cout << "Total Rental Price: " << price << " INR" << endl;
-                return;
+                if (events[i].data.u64 == listenerTag)
+                    acceptConnections();
+                else if (events[i].data.u64 == wakeupTag)
+                    deliverReplies(batch);
+                else
+                    serviceConnection(events[i].data.u64, events[i].events, batch);
+            }
+            submit(batch);
+            // A failed log refuses changes until a snapshot resets it; on a
+            // disk that keeps failing, try that every few seconds at most.
+            bool repairLog = state.log.hasFailed() && chrono::steady_clock::now() >= nextLogRepair;
+            if (state.log.size() >= logCompactionBytes || repairLog)
+            {
+                unique_lock<shared_mutex> exclusive(stateLock);
+                if (!compactLogIfNeeded(state))
+                    nextLogRepair = chrono::steady_clock::now() + chrono::seconds(5);
             }
         }
-        cout << "Car ID not found!\n";
     }
+};
 
-    void loginCustomer()
+// Load generator for server mode: opens the given number of connections to
+// 127.0.0.1:port, keeps up to depth requests in flight on each for the given
+// number of seconds and reports throughput and latency percentiles as one
+// JSON line. The mix is 50% quotes, 20% bookings, 15% returns, 10% logins
+// and 5% routes against the default fleet and locations.
+void runLoadGenerator(uint16_t port, int connectionCount, int seconds, int depth)
+{
+    struct ClientTotals
     {
-        string name, license;
-        cout << "\nEnter your name: ";
-        cin.ignore();
-        getline(cin, name);
-        cout << "Enter your license: ";
-        getline(cin, license);
+        vector<uint64_t> buckets = vector<uint64_t>(LatencyBuckets::count, 0);
+        uint64_t requests = 0, succeeded = 0, maximum = 0;
+        bool failed = false;
+    };
+    vector<ClientTotals> totals(connectionCount);
+    auto deadline = chrono::steady_clock::now() + chrono::seconds(seconds);
+    auto nanosecondsSince = [](chrono::steady_clock::time_point start)
+    {
+        return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    };
+    static const char *const locations[] = {"Mumbai", "Pune", "Nashik", "Nagpur"};
 
-        ifstream inFile("customers.txt");
-        if (inFile)
+    auto client = [&](int index)
+    {
+        ClientTotals &mine = totals[index];
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (fd < 0 || connect(fd, (sockaddr *)&address, sizeof(address)) < 0)
         {
-            string line;
-            bool found = false;
-            while (getline(inFile, line))
-            {
-                size_t pos1 = line.find(',');
-                size_t pos2 = line.find(',', pos1 + 1);
-                string fileName = line.substr(0, pos1);
-                string fileLicense = line.substr(pos1 + 1, pos2 - pos1 - 1);
+            mine.failed = true;
+            if (fd >= 0)
+                close(fd);
+            return;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
 
-                if (fileName == name && fileLicense == license)
+        BenchRandom random(index + 1);
+        deque<chrono::steady_clock::time_point> sentAt;
+        string out, in, request;
+        char buffer[64 * 1024];
+        uint64_t sequence = 0;
+        for (;;)
+        {
+            auto now = chrono::steady_clock::now();
+            out.clear();
+            while ((int)sentAt.size() < depth && now < deadline)
+            {
+                request.clear();
+                JsonWriter writer(request);
+                writer.field("id", (long long)sequence++);
+                int carId = 1 + (int)random.below(14);
+                size_t pick = random.below(100);
+                if (pick < 50)
+                    writer.field("op", "quote").field("carId", (long long)carId).field("type", "hour").field("duration", (long long)(1 + random.below(72)));
+                else if (pick < 70)
+                    writer.field("op", "book").field("carId", (long long)carId).field("customer", "loadgen").field("type", "hour").field("duration", 1LL);
+                else if (pick < 85)
+                    writer.field("op", "return").field("carId", (long long)carId);
+                else if (pick < 95)
+                    writer.field("op", "login").field("name", "loadgen").field("license", "DL0000");
+                else
+                    writer.field("op", "route").field("from", locations[random.below(4)]).field("to", locations[random.below(4)]);
+                writer.end();
+                request.pop_back();
+                appendFrame(out, request);
+                sentAt.push_back(now);
+            }
+            for (size_t sent = 0; sent < out.size();)
+            {
+                ssize_t written = send(fd, out.data() + sent, out.size() - sent, MSG_NOSIGNAL);
+                if (written <= 0)
                 {
-                    cout << "Login successful! Welcome, " << name << ".\n";
-                    found = true;
-                    break;
+                    mine.failed = true;
+                    close(fd);
+                    return;
                 }
+                sent += (size_t)written;
             }
-            inFile.close();
+            if (sentAt.empty())
+                break;
 
-            if (!found)
+            ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+            if (received <= 0)
             {
-                cout << "Login failed. Customer not found.\n";
+                mine.failed = true;
+                break;
             }
-        }
-        else
-        {
-            cout << "Error opening customer data file.\n";
-        }
-    }
-
-    void displayCars(string category)
-    {
-        cout << "\nAvailable cars in category '" << category << "':\n";
-        for (Car &car : cars)
-        {
-            if (car.category == category && car.isAvailable)
+            in.append(buffer, (size_t)received);
+            size_t offset = 0;
+            for (long long length; (length = frameLength(in.data() + offset, in.size() - offset)) >= 0 &&
+                                    in.size() - offset >= 4 + (size_t)length;
+                 offset += 4 + (size_t)length)
             {
-                cout << "ID: " << car.id << ", Name: " << car.name << endl;
+                uint64_t latency = nanosecondsSince(sentAt.front());
+                sentAt.pop_front();
+                mine.buckets[LatencyBuckets::of(latency)]++;
+                mine.maximum = max(mine.maximum, latency);
+                mine.requests++;
+                if (string_view(in.data() + offset + 4, (size_t)length).find("\"ok\":true") != string_view::npos)
+                    mine.succeeded++;
             }
+            in.erase(0, offset);
         }
-    }
+        close(fd);
+    };
 
-    void registerCustomer()
+    auto started = chrono::steady_clock::now();
+    vector<thread> clients;
+    for (int i = 0; i < connectionCount; i++)
+        clients.emplace_back(client, i);
+    for (thread &clientThread : clients)
+        clientThread.join();
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+    ClientTotals all;
+    int failedConnections = 0;
+    for (const ClientTotals &mine : totals)
     {
-        string name, license, aadhar, mobileNumber;
-        cout << "\nEnter customer details:\n";
-        cout << "Name: ";
-        cin.ignore();
-        getline(cin, name);
-        cout << "License: ";
-        getline(cin, license);
-        cout << "Aadhar: ";
-        getline(cin, aadhar);
-        cout << "Mobile Number: ";
-        getline(cin, mobileNumber);
+        for (int b = 0; b < LatencyBuckets::count; b++)
+            all.buckets[b] += mine.buckets[b];
+        all.requests += mine.requests;
+        all.succeeded += mine.succeeded;
+        all.maximum = max(all.maximum, mine.maximum);
+        failedConnections += mine.failed;
+    }
+    uint64_t percentiles[3] = {0, 0, 0};
+    const double quantiles[3] = {0.50, 0.99, 0.999};
+    uint64_t seen = 0;
+    int next = 0;
+    for (int b = 0; b < LatencyBuckets::count && next < 3 && all.requests; b++)
+    {
+        seen += all.buckets[b];
+        while (next < 3 && seen >= (uint64_t)ceil(quantiles[next] * all.requests))
+            percentiles[next++] = min(LatencyBuckets::highest(b), all.maximum);
+    }
+    cout << "{\"connections\":" << connectionCount << ",\"depth\":" << depth << ",\"seconds\":" << fixed
+         << setprecision(3) << elapsed << ",\"requests\":" << all.requests << ",\"succeeded\":" << all.succeeded
+         << ",\"failedConnections\":" << failedConnections << ",\"requestsPerSecond\":" << setprecision(0)
+         << all.requests / max(elapsed, 1e-9) << ",\"p50Ns\":" << percentiles[0] << ",\"p99Ns\":" << percentiles[1]
+         << ",\"p999Ns\":" << percentiles[2] << ",\"maxNs\":" << all.maximum << "}" << defaultfloat
+         << setprecision(6) << endl;
+}
+#endif
 
-        customers.push_back(Customer(name, license, aadhar, mobileNumber));
-        cout << "Customer registered successfully!\n";
-        ofstream outFile("customers.txt", ios::app);
-        if (outFile)
-        {
-            outFile << name << "," << license << "," << aadhar << "," << mobileNumber << "\n";
-            outFile.close();
-            cout << "Customer registered successfully and saved to file!\n";
-        }
+int main(int argc, char *argv[])
+{
+    if (argc > 2 && string(argv[1]) == "--bench")
+    {
+        string suite = argv[2];
+        if (suite == "waitlist")
+            benchmarkWaitlists();
+        else if (suite == "booking")
+            benchmarkBooking();
+        else if (suite == "core")
+            benchmarkCore(argc > 3 ? min(7, max(3, atoi(argv[3]))) : 5);
+        else if (suite == "rates")
+            return benchmarkRates() ? 0 : 1;
         else
-        {
-            cout << "Error saving customer data to file.\n";
-        }
+            cout << "Unknown benchmark: " << suite << "\n";
+        return 0;
     }
 
-    void bookCar()
+    // --batch [file]: run JSON-lines commands from the file (or stdin) and
+    // print one JSON result per command.
+    if (argc > 1 && string(argv[1]) == "--batch")
     {
-
-        string rentalType;
-        int hoursOrDays;
-        int carId;
-        string customerName;
-
-        cout << "\nEnter your name: ";
-        cin.ignore();
-        getline(cin, customerName);
-        cout << "Enter Car ID to book: ";
-        cin >> carId;
-
-        cout << "Do you want to rent the car for a day or hour? (Enter 'day' or 'hour'): ";
-        cin >> rentalType;
-
-        cout << "How many " << (rentalType == "day" ? "days" : "hours") << " do you want to rent the car for? ";
-        cin >> hoursOrDays;
-
-        calculateRentalPrice(carId, rentalType, hoursOrDays);
-
-        for (Car &car : cars)
+        unique_ptr<SystemState> state = loadSystemState(snapshotPath);
+        ifstream file;
+        if (argc > 2 && string(argv[2]) != "-")
         {
-            if (car.id == carId && car.isAvailable)
+            file.open(argv[2], ios::binary);
+            if (!file)
             {
-                car.isAvailable = false;
-                cout << "Car '" << car.name << "' booked successfully by " << customerName << "!\n";
-                return;
+                cerr << "Cannot open " << argv[2] << "\n";
+                return 1;
             }
         }
-        cout << "Car not available or invalid ID!\n";
+        ios::sync_with_stdio(false);
+        runBatch(file.is_open() ? file : cin, cout, *state);
+        if (!saveSystemState(snapshotPath, *state))
+            cerr << "Could not save the system state to " << snapshotPath << ".\n";
+        ofstream metricsOut(metricsPath, ios::app);
+        OperationMetrics::writeJson(metricsOut);
+        return 0;
     }
 
-    void returnCar()
+    // --merge-customers [file]: fold duplicate customers (shared license,
+    // Aadhar or mobile number) into their earliest record.
+    if (argc > 1 && string(argv[1]) == "--merge-customers")
     {
-        int carId;
-        cout << "\nEnter Car ID to return: ";
-        cin >> carId;
-
-        for (Car &car : cars)
+        string path = argc > 2 ? argv[2] : "customers.txt";
+        size_t kept;
+        vector<CustomerMerge> merges;
+        if (!mergeDuplicateCustomers(path, kept, merges))
         {
-            if (car.id == carId && !car.isAvailable)
-            {
-                car.isAvailable = true;
-                cout << "Car '" << car.name << "' returned successfully!\n";
-                return;
-            }
+            cerr << "Cannot rewrite " << path << "\n";
+            return 1;
         }
-        cout << "Invalid Car ID or the car is already available!\n";
+        for (const CustomerMerge &merge : merges)
+            cout << "Line " << merge.line << " merged into line " << merge.intoLine << " (same "
+                 << customerKeyName(merge.sharedKey) << ")\n";
+        cout << "Kept " << kept << " customers, merged " << merges.size() << " duplicates.\n";
+        return 0;
     }
 
-    void usageDetails()
+    // --serve [port] [workers]: answer framed JSON commands on 127.0.0.1.
+    // --loadgen [port] [connections] [seconds] [depth]: drive a running server.
+    if (argc > 1 && (string(argv[1]) == "--serve" || string(argv[1]) == "--loadgen"))
     {
-        int carId;
-        cout << "\nEnter Car ID to check details: ";
-        cin >> carId;
-
-        for (Car &car : cars)
+#ifdef __linux__
+        uint16_t port = (uint16_t)(argc > 2 ? atoi(argv[2]) : 8090);
+        if (string(argv[1]) == "--loadgen")
+        {
+            runLoadGenerator(port, argc > 3 ? max(1, atoi(argv[3])) : 16, argc > 4 ? max(1, atoi(argv[4])) : 10,
+                             argc > 5 ? max(1, atoi(argv[5])) : 32);
+            return 0;
+        }
+        unsigned workers = argc > 3 ? (unsigned)max(1, atoi(argv[3])) : max(1u, thread::hardware_concurrency());
+        unique_ptr<SystemState> state = loadSystemState(snapshotPath);
         {
-            if (car.id == carId)
+            RequestServer server(*state);
+            if (!server.start(port, workers))
             {
-                cout << "Car Name: " << car.name << ", Category: " << car.category
-                     << ", Availability: " << (car.isAvailable ? "Available" : "Not Available") << endl;
-                return;
+                cerr << "Cannot listen on 127.0.0.1:" << port << ": " << strerror(errno) << "\n";
+                return 1;
             }
+            signal(SIGINT, requestServerStop);
+            signal(SIGTERM, requestServerStop);
+            signal(SIGPIPE, SIG_IGN);
+            cout << "Serving on 127.0.0.1:" << port << " with " << workers << " workers; Ctrl+C to stop." << endl;
+            server.run();
         }
-        cout << "Car not found!\n";
+        if (!saveSystemState(snapshotPath, *state))
+            cerr << "Could not save the system state to " << snapshotPath << ".\n";
+        ofstream metricsOut(metricsPath, ios::app);
+        OperationMetrics::writeJson(metricsOut);
+        return 0;
+#else
+        cout << "Server mode is only available on Linux.\n";
+        return 1;
+#endif
     }
-};
 
-int main()
-{
-    Waitlist waitlist;
-    ActionStack actions;
-    Graph rentalLocations;
-    BookingHistory history;
-    VehicleTree inventory;
+    unique_ptr<SystemState> state = loadSystemState(snapshotPath);
+    ConcurrentWaitlist &waitlist = state->waitlist;
+    ActionStack &actions = state->actions;
+    Graph &rentalLocations = state->rentalLocations;
+    BookingHistory &history = state->history;
+    VehicleTree &inventory = state->inventory;
 
     int c;
     cout << "enter whether you are owner or a customer(1 for owner and 2 for customer):";
@@ -707,6 +7929,11 @@ int main()
             cout << "7. Manage Waitlist\n";
             cout << "8. Undo Last Action\n";
             cout << "9. Find Shortest Distance Between Locations\n";
+            cout << "10. Toggle Precomputed Distance Index\n";
+            cout << "11. Import Road Network From File\n";
+            cout << "12. View Vehicles In ID Range\n";
+            cout << "13. View Operation Metrics\n";
+            cout << "14. Toggle Parallel Route Search\n";
             cout << "0. Exit\n";
             cout << "Enter your choice: ";
             cin >> choice;
@@ -740,7 +7967,8 @@ int main()
                 cin >> to;
                 cout << "Enter Distance: ";
                 cin >> distance;
-                rentalLocations.addEdge(from, to, distance);
+                if (!rentalLocations.addEdge(from, to, distance))
+                    cout << "Road added but could not be logged; it will only be saved on exit.\n";
                 actions.pushAction("Added Rental Location: " + from + " -> " + to);
                 break;
             }
@@ -773,12 +8001,26 @@ int main()
                     cout << "Enter Customer Name: ";
                     cin.ignore();
                     getline(cin, customer);
-                    waitlist.enqueue(customer);
+                    bool added;
+                    {
+                        OperationTimer timer(Metric::Waitlist);
+                        added = waitlist.enqueue(customer);
+                    }
+                    if (!added)
+                    {
+                        cout << "Waitlist is full.\n";
+                        break;
+                    }
                     actions.pushAction("Added to Waitlist: " + customer);
                 }
                 else if (subChoice == 2)
                 {
-                    cout << "Serving Customer: " << waitlist.dequeue() << endl;
+                    string served;
+                    {
+                        OperationTimer timer(Metric::Waitlist);
+                        served = waitlist.dequeue();
+                    }
+                    cout << "Serving Customer: " << served << endl;
                 }
                 else if (subChoice == 3)
                 {
@@ -807,6 +8049,59 @@ int main()
                 }
                 break;
             }
+            case 10:
+                rentalLocations.enableContractionHierarchy(!rentalLocations.contractionHierarchyEnabled());
+                cout << "Precomputed distance index "
+                     << (rentalLocations.contractionHierarchyEnabled() ? "enabled" : "disabled") << ".\n";
+                break;
+            case 11:
+            {
+                string path;
+                cout << "Enter edge-list or DIMACS file path: ";
+                cin >> path;
+                auto started = chrono::steady_clock::now();
+                long long loaded = rentalLocations.loadEdgeFile(path);
+                auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - started);
+                if (loaded == -1)
+                {
+                    cout << "Could not open " << path << ".\n";
+                }
+                else if (loaded < 0)
+                {
+                    cout << "Roads loaded but could not be logged; they will only be saved on exit.\n";
+                    actions.pushAction("Imported Rental Locations: " + path);
+                }
+                else
+                {
+                    cout << "Loaded " << loaded << " roads (" << rentalLocations.nodeCount() << " locations) in "
+                         << elapsed.count() << " ms.\n";
+                    actions.pushAction("Imported Rental Locations: " + path);
+                }
+                break;
+            }
+            case 12:
+            {
+                int low, high;
+                cout << "Enter lowest Vehicle ID: ";
+                cin >> low;
+                cout << "Enter highest Vehicle ID: ";
+                cin >> high;
+                inventory.displayRange(low, high);
+                break;
+            }
+            case 13:
+                OperationMetrics::display();
+                cout << "Every session appends these figures as JSON lines to " << metricsPath << " on exit.\n";
+                break;
+            case 14:
+            {
+                bool parallel = rentalLocations.shortestPathEngine() != ShortestPathEngine::DeltaStepping;
+                rentalLocations.setShortestPathEngine(parallel ? ShortestPathEngine::DeltaStepping : ShortestPathEngine::Dijkstra);
+                cout << "Parallel route search (delta-stepping) " << (parallel ? "enabled" : "disabled") << ".\n";
+                if (rentalLocations.contractionHierarchyEnabled())
+                    cout << "The precomputed distance index is on and still answers queries first.\n";
+                break;
+            }
             case 0:
                 cout << "Exiting program. Goodbye!" << endl;
                 break;
@@ -820,49 +8115,14 @@ int main()
     case 2:
 
     {
-        CarRentalSystem carRentalSystem;
-        int carId;
-        string rentalType;
-        int hoursOrDays;
-        vector<RentalCompany> rentalCompanies = {
-            {"Mumbai Car Rentals", "123 Marine Drive, Mumbai", "Mumbai", "400020"},
-            {"Delhi Wheels", "456 Connaught Place, New Delhi", "New Delhi", "110001"},
-            {"Bangalore Speedy Rentals", "789 MG Road, Bengaluru", "Bengaluru", "560001"},
-            {"Hyderabad Quick Rentals", "101 Banjara Hills, Hyderabad", "Hyderabad", "500034"},
-            {"Chennai CityX Rentals", "202 Anna Salai, Chennai", "Chennai", "600002"},
-            {"Kolkata Prime Rentals", "303 Park Street, Kolkata", "Kolkata", "700016"},
-            {"Pune Drive Rentals", "404 FC Road, Pune", "Pune", "411005"},
-            {"Ahmedabad Auto Rentals", "505 CG Road, Ahmedabad", "Ahmedabad", "380009"},
-            {"Jaipur PinkCity Rentals", "606 MI Road, Jaipur", "Jaipur", "302001"},
-            {"Lucknow Urban Rentals", "707 Hazratganj, Lucknow", "Lucknow", "226001"},
-            {"Chandigarh City Rentals", "808 Sector 17, Chandigarh", "Chandigarh", "160017"},
-            {"Indore Fast Rentals", "909 MG Road, Indore", "Indore", "452001"},
-            {"Bhopal Eco Rentals", "101 New Market, Bhopal", "Bhopal", "462003"},
-            {"Thiruvananthapuram Rentals", "202 MG Road, Thiruvananthapuram", "Thiruvananthapuram", "695001"},
-            {"Guwahati Speed Rentals", "303 GS Road, Guwahati", "Guwahati", "781005"},
-            {"Nagpur Orange Rentals", "404 Civil Lines, Nagpur", "Nagpur", "440001"},
-            {"Visakhapatnam Rentals", "505 Beach Road, Visakhapatnam", "Visakhapatnam", "530001"},
-            {"Patna Smart Rentals", "606 Gandhi Maidan, Patna", "Patna", "800001"},
-            {"Vadodara Car Rentals", "707 Alkapuri, Vadodara", "Vadodara", "390007"},
-            {"Surat Rentals", "808 Ring Road, Surat", "Surat", "395003"},
-            {"Kanpur Ride Rentals", "909 Mall Road, Kanpur", "Kanpur", "208001"},
-            {"Coimbatore Fast Rentals", "101 Avinashi Road, Coimbatore", "Coimbatore", "641018"},
-            {"Madurai Quick Rentals", "202 Meenakshi Amman Temple Road, Madurai", "Madurai", "625001"},
-            {"Ranchi Drive Rentals", "303 Main Road, Ranchi", "Ranchi", "834001"},
-            {"Raipur Rentals", "404 Pandri, Raipur", "Raipur", "492001"},
-            {"Mysuru Rentals", "505 Devaraja Market, Mysuru", "Mysuru", "570001"},
-            {"Varanasi Rentals", "606 Assi Ghat Road, Varanasi", "Varanasi", "221005"},
-            {"Agra City Rentals", "707 Taj Road, Agra", "Agra", "282001"},
-            {"Amritsar Rentals", "808 Golden Temple Road, Amritsar", "Amritsar", "143001"},
-            {"Meerut Car Rentals", "909 Shastri Nagar, Meerut", "Meerut", "250001"}};
         cin.ignore();
         string userCity, pincode;
         cout << "Enter your city: ";
         getline(cin, userCity);
         cout << "Enter its pincode: ";
         getline(cin, pincode);
-        printNearbyRentalCompanies(userCity, pincode, rentalCompanies);
-        CarRentalSystem system;
+        printNearbyRentalCompanies(userCity, pincode, state->branches);
+        CustomerConsole console(state->rentals);
         int choice;
 
         do
@@ -875,6 +8135,9 @@ int main()
             cout << "\n5.Car usage details";
             cout << "\n6.Login Customer";
             cout << "\n7.Exit.Thank You for Visiting";
+            cout << "\n8.Join Waitlist for a Category";
+            cout << "\n9.Reserve a Car for Later";
+            cout << "\n10.Find Cars Free in a Period";
             cout << "\nEnter your choice: ";
             cin >> choice;
 
@@ -885,50 +8148,37 @@ int main()
                 string category;
                 cout << "Enter car category (SUV/Sedan/Hatchback): ";
                 cin >> category;
-                system.displayCars(category);
+                console.displayCars(category);
                 break;
             }
             case 2:
-                system.registerCustomer();
+                console.registerCustomer();
                 break;
             case 3:
-                cout << "===============================================\n";
-                cout << " Categories of Cars in our system are: \n";
-                cout << " 1. SUV   | 2. Sedan   | 3. Hatchback\n";
-                cout << "===============================================\n";
-                Sleep(2000);
-
-                cout << " Car Category    | Daily Wages      | Hourly Wages   \n";
-                cout << "-------------------------------------------------------\n";
-
-                cout << setw(16) << "SUV"
-                     << setw(20) << "10,000 INR"
-                     << setw(15) << "500 INR" << endl;
-
-                cout << setw(16) << "Sedan"
-                     << setw(20) << "5,000 INR"
-                     << setw(15) << "300 INR" << endl;
-
-                cout << setw(16) << "Hatchback"
-                     << setw(20) << "4,000 INR"
-                     << setw(15) << "250 INR" << endl;
-
-                cout << "===============================================\n";
-                Sleep(2000);
-                system.bookCar();
+                console.displayRates();
+                console.bookCar();
                 break;
             case 4:
-                system.returnCar();
+                console.returnCar();
                 break;
             case 5:
-                system.usageDetails();
+                console.usageDetails();
                 break;
             case 6:
-                system.loginCustomer();
+                console.loginCustomer();
                 break;
             case 7:
                 cout << "Exiting system. Goodbye!\n";
                 break;
+            case 8:
+                console.joinWaitlist();
+                break;
+            case 9:
+                console.reserveCar();
+                break;
+            case 10:
+                console.displayFreeCars();
+                break;
             default:
                 cout << "Invalid choice! Please try again.\n";
             }
@@ -942,5 +8192,9 @@ int main()
     }
     }
 
+    if (!saveSystemState(snapshotPath, *state))
+        cout << "Could not save the system state to " << snapshotPath << ".\n";
+    ofstream metricsOut(metricsPath, ios::app);
+    OperationMetrics::writeJson(metricsOut);
     return 0;
 }
\ No newline at end of file